@@ -2,77 +2,114 @@
 #include <allegro5/allegro_primitives.h>
 #include <mpich/mpi.h>
 #include "../headers/Settings.hpp"
+#include "../headers/Person.hpp"
+#include "../headers/PopulationLoader.hpp"
+#include "../headers/Outbreak.hpp"
+#include "../headers/Ensemble.hpp"
+#include "../headers/Stencil.hpp"
+#include "../headers/CompactState.hpp"
+#include "../headers/Grid.hpp"
+#include "../headers/GeometricSkip.hpp"
+#include "../headers/Balance.hpp"
 
 #define debug
 #define usingGraphics
 
-union Person {
-	struct {
-		uint8_t isInfected:1;
-		uint8_t isImmune:1;
-		uint8_t isDead:1;
-		uint8_t isVaccinated:1;
-		uint8_t daysOfIncubation:2;
-		uint8_t daysOfInfection:3;
-		uint8_t age:7;
-	}values;
-	
-	unsigned short all;
-};
-
-Settings settings = Settings();
-
-#define procs 6
+// ages sit in their own read-only array, only one byte per person is double buffered and exchanged
+#define usingCompactState
+
+// memory order of the local strips and of the gathered frame, RowMajor or ColumnMajor
+#define layout ColumnMajor
+
+Settings settings;
+
 #define root 0
 
-int rows = settings.getMatrixSize();
-int cols = settings.getMatrixSize();
-int square = settings.getSquareSize();
+int rows;
+int cols;
+int square;
+
+int numberOfGenerations;
+
+int millisecondsToWaitForEachGeneration;
+
+Rules rules;
+
+// spontaneous vaccinations, drawn as gaps between hits instead of one roll per person
+GeometricSkip vaccinations;
 
-int numberOfGenerations = settings.getNumberOfGenerations();
+#ifdef usingCompactState
+    uint8_t * ages;
+    CompactPerson * readState;
+    CompactPerson * writeState;
 
-int infectionPercentage = settings.getInfectionPercentage();
-int immunityPercentage = settings.getImmunityPercentage();
-int loseImmunityPercentage = settings.getLoseImmunityPercentage();
-int vaccinationPercentage = settings.getVaccinationPercentage();
-int deathPercentage = settings.getDeathPercentage();
+    TransitionTable * transitions;
+    CompactStates * compactStates;
 
-int millisecondsToWaitForEachGeneration = settings.getMillisecodsToWaitForEachGeneration();
+    MPI_Datatype stateColumnType;
+#endif //usingCompactState
 
+Person * readMatrix;
+Person * writeMatrix;
 
-Person * readMatrix = new Person[rows * ((cols / procs) + 2)];
-Person * writeMatrix = new Person[rows * ((cols / procs) + 2)];
+// the local strips hold localCols owned columns, from global column firstColumn, plus a halo column
+// on each side
+Grid<layout> local;
+
+int firstColumn;
+int localCols;
+
+// owned columns of every rank, resized by rebalance() every rebalanceInterval generations
+std::vector<int> stripCols;
+int rebalanceInterval;
+double updateSeconds = 0;
 
 int rank, left, right, size;
 
+// replica run by this rank, a single one spanning every rank unless ensembleGroupSize is set
+Ensemble ensemble;
+EnsembleStatistics * statistics = NULL;
+int worldRank;
+
 
 inline void initialize();
 
 #ifdef usingGraphics
     ALLEGRO_DISPLAY * display = NULL;
 
-    // get color from settings
-    ALLEGRO_COLOR defaultPersonColor = al_map_rgb(settings.getDefaultPersonColor().r, settings.getDefaultPersonColor().g, settings.getDefaultPersonColor().b);
-    ALLEGRO_COLOR infectedColor = al_map_rgb(settings.getInfectedColor().r, settings.getInfectedColor().g, settings.getInfectedColor().b);
-    ALLEGRO_COLOR immuneColor = al_map_rgb(settings.getImmuneColor().r, settings.getImmuneColor().g, settings.getImmuneColor().b);
-    ALLEGRO_COLOR deadColor = al_map_rgb(settings.getDeadColor().r, settings.getDeadColor().g, settings.getDeadColor().b);
-    ALLEGRO_COLOR vaccinatedColor = al_map_rgb(settings.getVaccinatedColor().r, settings.getVaccinatedColor().g, settings.getVaccinatedColor().b);
-    ALLEGRO_COLOR incubationColor = al_map_rgb(settings.getIncubationColor().r, settings.getIncubationColor().g, settings.getIncubationColor().b);
+    // colors from settings, set by loadSettings()
+    ALLEGRO_COLOR defaultPersonColor;
+    ALLEGRO_COLOR infectedColor;
+    ALLEGRO_COLOR immuneColor;
+    ALLEGRO_COLOR deadColor;
+    ALLEGRO_COLOR vaccinatedColor;
+    ALLEGRO_COLOR incubationColor;
 #endif //usignGraphics
 
 MPI_Datatype columnType;
 MPI_Datatype subMatrixType;
 MPI_Comm comm;
 
+// the borders sent this generation, they have to arrive before their buffer is written again
+MPI_Request borderRequests[2];
+
+inline void loadSettings(int argc, char * argv[]);
+inline void split(const std::vector<int> & widths);
+inline void createTypes();
+inline void freeTypes();
+inline void rebalance();
 inline void sendBorders();
 inline void receiveBorders();
-inline void update();
-inline void updateBorders();
-inline void draw(Person * readMatrix);
+inline void update(int firstColumn, int lastColumn);
+inline void updateCompactState(int firstColumn, int lastColumn);
+inline void compactPeople();
+inline void expandPeople();
+inline void draw(Person * people, const Block & block);
 inline void swap();
+inline void countGeneration(int generation);
 inline void finalize();
 
-inline int m(int i, int j) {return j * rows + i;}
+inline size_t m(int i, int j) {return local.index(i, j);}
 
 
 
@@ -81,53 +118,75 @@ inline int m(int i, int j) {return j * rows + i;}
 
 int main(int argc, char * argv[])
 {
-    int source, dest;
-    double elapsedTime;
+    double elapsedTime = 0;
 
     MPI_Init(&argc, &argv);
-    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
-    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    MPI_Comm_rank(MPI_COMM_WORLD, &worldRank);
+
+    loadSettings(argc, argv);
+
+    // from here on every rank only talks to the ranks of its own replica
+    MPI_Comm_rank(ensemble.comm, &rank);
+    MPI_Comm_size(ensemble.comm, &size);
 
     if (rank == root) elapsedTime = MPI_Wtime();
 
-    MPI_Type_contiguous(rows, MPI_UNSIGNED_SHORT, &columnType);
-    MPI_Type_commit(&columnType);
+    // every rank of the replica gets here, the job stops instead of leaving the others in a collective
+    if (cols < 2 * size)
+    {
+        if (rank == root) fprintf(stderr, "ERROR: every rank needs at least 2 columns\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    split(evenSizes(cols, size));
+    createTypes();
 
     int dims[1] = {size};
     int periods[1] = {1};
 
-    MPI_Cart_create(MPI_COMM_WORLD, 1, dims, periods, 0, &comm);
+    MPI_Cart_create(ensemble.comm, 1, dims, periods, 0, &comm);
     MPI_Cart_shift(comm, 0, 1, &left, &right);
 
     #ifdef usingGraphics
 
-        Person * wholeMatrix;
+        // only the first replica is drawn
+        bool drawing = ensemble.group == 0;
 
-        if (rank == root)
+        // root draws the strips one at a time, it never holds more than the widest of them
+        std::vector<Person> frame;
+
+        if (rank == root && drawing)
         {
             al_init();
             display = al_create_display(cols * square, rows * square);
             al_init_primitives_addon();
             al_set_app_name("Covid19 Simulation");
-
-            Person * tmp = new Person[rows * cols];
-            wholeMatrix = tmp;
         }
 
     #endif // usingGraphics
 
     for (int i = 0; i < rows; ++i)
     {
-        for (int j = 1; j < cols / procs + 1; ++j)
+        for (int j = 1; j < localCols + 1; ++j)
         {
             readMatrix[m(i, j)].all = 0;
             writeMatrix[m(i, j)].all = 0;
         }
     }
 
-    srand(time(NULL) + rank);
+    srand(settings.getSeed() + worldRank);
     initialize();
 
+    #ifdef usingCompactState
+        compactPeople();
+    #endif //usingCompactState
+
+    if (settings.getEnsembleGroupSize() > 0)
+    {
+        statistics = new EnsembleStatistics(numberOfGenerations);
+        countGeneration(0);
+    }
+
 
     for (int i = 1; i <= numberOfGenerations; ++i)
     {
@@ -137,31 +196,67 @@ int main(int argc, char * argv[])
         #endif // debug
         
         #ifdef usingGraphics
-        MPI_Request request;
-        MPI_Isend(&readMatrix[m(0, 2)], cols/procs*2, columnType, root, 0, comm, &request);
+        #ifdef usingCompactState
+            if (drawing) expandPeople();
+        #endif //usingCompactState
 
-            /* Person * buffer = &readMatrix[m(0,1)];
-            MPI_Gather(buffer, 1, subMatrixType, wholeMatrix, 1, subMatrixType, root, comm); */
+        MPI_Request request;
+        if (drawing) MPI_Isend(readMatrix, 1, subMatrixType, root, 0, comm, &request);
 
-            if (rank == root)
+            if (rank == root && drawing)
             {
-                for (int i = 0; i < size; ++i)
-                    MPI_Recv(&wholeMatrix[m(0, i * cols / procs)], cols/procs*2, columnType, i, 0, comm, MPI_STATUS_IGNORE);
+                std::vector<int> offsets = offsetsOf(stripCols);
 
-                draw(wholeMatrix);
+                al_clear_to_color(defaultPersonColor);
+
+                for (int r = 0; r < size; ++r)
+                {
+                    frame.resize((size_t) rows * stripCols[r]);
+                    MPI_Recv(frame.data(), rows * stripCols[r], personType(), r, 0, comm, MPI_STATUS_IGNORE);
+
+                    draw(frame.data(), {0, offsets[r], rows, stripCols[r]});
+                }
+
+                al_flip_display();
             }
 
+        if (drawing) MPI_Wait(&request, MPI_STATUS_IGNORE);
+
         #endif // usingGraphics
         
         sendBorders();
-        update();
+
+        double start = MPI_Wtime();
+
+        #ifdef usingCompactState
+            updateCompactState(2, localCols);
+        #else
+            update(2, localCols);
+        #endif //usingCompactState
+
+        updateSeconds += MPI_Wtime() - start;
+
         receiveBorders();
-        updateBorders();
+
+        start = MPI_Wtime();
+
+        #ifdef usingCompactState
+            updateCompactState(1, 2);
+            updateCompactState(localCols, localCols + 1);
+        #else
+            update(1, 2);
+            update(localCols, localCols + 1);
+        #endif //usingCompactState
+
+        updateSeconds += MPI_Wtime() - start;
 
         swap();
 
-        MPI_Barrier(comm);
+        if (statistics) countGeneration(i);
 
+        if (rebalanceInterval > 0 && i % rebalanceInterval == 0 && i < numberOfGenerations) rebalance();
+
+        // no barrier, the halos keep every rank within a generation of its neighbours
         sleep(millisecondsToWaitForEachGeneration);
     }
 
@@ -179,7 +274,7 @@ int main(int argc, char * argv[])
             printf("Speed-up: %3.3f\n", speedUp);
 
             // efficiency
-            double efficiency = speedUp / (double) procs;
+            double efficiency = speedUp / (double) size;
             printf("Efficiency: %3.3f\n", efficiency);
         }
         else
@@ -189,19 +284,21 @@ int main(int argc, char * argv[])
             printf("Speed-up: %3.3f\n", speedUp);
 
             // efficiency
-            double efficiency = speedUp / (double) procs;
+            double efficiency = speedUp / (double) size;
             printf("Efficiency: %3.3f", efficiency);
         }
     }
 
-    #ifdef usingGraphics
-
-    if (rank == root)
+    if (statistics)
     {
-        delete [] wholeMatrix;
-        al_destroy_display(display);
+        statistics->write(ensemble, settings.getEnsembleOutput());
+        delete statistics;
     }
 
+    #ifdef usingGraphics
+
+    if (rank == root && drawing) al_destroy_display(display);
+
     #endif // usingGraphics
 
     
@@ -210,348 +307,348 @@ int main(int argc, char * argv[])
     return 0;
 }
 
-inline void initialize()
+inline void loadSettings(int argc, char * argv[])
 {
-    for (int i = 0; i < rows; ++i)
-    {
-        for (int j = 1; j < cols / procs + 3; ++j)
-        {
-            readMatrix[m(i,j)].values.age = rand() % 100;
-        }
-    }
+    // root parses the config file, every other rank gets it from a broadcast
+    settings = Settings::load(argc, argv, MPI_COMM_WORLD);
 
-    if (size == 1) readMatrix[m(rows/2, cols/2)].values.isInfected = 1;
-    else
-    {
-        int centerRank = size / 2;
+    // the swept parameter of this replica has to be in place before the globals are read
+    ensemble = splitEnsemble(settings, MPI_COMM_WORLD);
 
-        if (rank == centerRank)
-        {   
-            if (size % 2 == 0)
-            {
-                readMatrix[m(rows/2, 2)].values.isInfected = 1;
-            }
-            else
-            {
-                readMatrix[m(rows/2, cols/procs/2)].values.isInfected = 1;
-            }
-        }
-    }
+    rows = settings.getRows();
+    cols = settings.getCols();
+
+    square = settings.getSquareSize();
+
+    numberOfGenerations = settings.getNumberOfGenerations();
+
+    rules = rulesFrom(settings);
+    vaccinations = spontaneousVaccinations(rules);
+
+    rebalanceInterval = settings.getRebalanceInterval();
+
+    #ifdef usingCompactState
+        transitions = new TransitionTable(rules);
+        compactStates = new CompactStates(*transitions);
+    #endif //usingCompactState
+
+    millisecondsToWaitForEachGeneration = settings.getMillisecodsToWaitForEachGeneration();
+
+    #ifdef usingGraphics
+        defaultPersonColor = al_map_rgb(settings.getDefaultPersonColor().r, settings.getDefaultPersonColor().g, settings.getDefaultPersonColor().b);
+        infectedColor = al_map_rgb(settings.getInfectedColor().r, settings.getInfectedColor().g, settings.getInfectedColor().b);
+        immuneColor = al_map_rgb(settings.getImmuneColor().r, settings.getImmuneColor().g, settings.getImmuneColor().b);
+        deadColor = al_map_rgb(settings.getDeadColor().r, settings.getDeadColor().g, settings.getDeadColor().b);
+        vaccinatedColor = al_map_rgb(settings.getVaccinatedColor().r, settings.getVaccinatedColor().g, settings.getVaccinatedColor().b);
+        incubationColor = al_map_rgb(settings.getIncubationColor().r, settings.getIncubationColor().g, settings.getIncubationColor().b);
+    #endif //usingGraphics
 }
 
-inline void finalize()
+// allocates the strip of this rank out of the owned columns of every rank
+inline void split(const std::vector<int> & widths)
 {
-    MPI_Finalize();
+    stripCols = widths;
+    firstColumn = offsetsOf(stripCols)[rank];
+    localCols = stripCols[rank];
+
+    local = Grid<layout>(rows, localCols + 2);
+
+    readMatrix = new Person[local.size()]();
+    writeMatrix = new Person[local.size()]();
+
+    #ifdef usingCompactState
+        ages = new uint8_t[local.size()]();
+        readState = new CompactPerson[local.size()]();
+        writeState = new CompactPerson[local.size()]();
+    #endif //usingCompactState
 }
 
-inline void update()
+inline void createTypes()
 {
-    for(int i = 0; i < rows; i++)
-    {
-        for(int j = 2; j < cols/procs; j++)
-        {
-            short infectedNeighbours = 0;
-            short vaccinatedNeighbours = 0;
+    // the types follow the layout, a column is contiguous in ColumnMajor and strided in RowMajor
+    local.columnType(rows, personType(), &columnType);
 
-            for(int k = -1; k <= 1; k++)
-            {
-                for(int l = -1; l <= 1; l++)
-                {
-                    // if the neighbour is not the person itself
-                    if(k != 0 || l != 0)
-                    {
-                        // if the neighbour is infected
-                        if(readMatrix[m((i + k + rows) % rows, ((j + l + cols) % cols))].values.isInfected == true &&
-                           readMatrix[m((i + k + rows) % rows, ((j + l + cols) % cols))].values.daysOfIncubation >= 2)
-                        {
-                            ++infectedNeighbours;
-                        }
-
-                        // if the neighbour is vaccinated
-                        if(readMatrix[m((i + k + rows) % rows, ((j + l + cols) % cols))].values.isVaccinated == true)
-                        {
-                            ++vaccinatedNeighbours;
-                        }
-                    }
-                }
-            }
+    // owned columns, used from the start of the strip
+    local.blockType(0, 1, rows, localCols, personType(), &subMatrixType);
 
-            // copy the person to the write matrix
-            writeMatrix[m(i,j)] = readMatrix[m(i,j)];
+    #ifdef usingCompactState
+        local.columnType(rows, MPI_BYTE, &stateColumnType);
+    #endif //usingCompactState
+}
 
-            if (readMatrix[m(i,j)].values.isDead || readMatrix[m(i,j)].values.isVaccinated)
-                continue;
-            
-            // if the person is infected
-            if (readMatrix[m(i,j)].values.isInfected && !readMatrix[(i,j)].values.isImmune)
-            {
+inline void freeTypes()
+{
+    MPI_Type_free(&columnType);
+    MPI_Type_free(&subMatrixType);
 
-                if (readMatrix[m(i,j)].values.daysOfIncubation < 3)
-                {
-                    ++writeMatrix[m(i,j)].values.daysOfIncubation;
-                    continue;
-                }
-                
-                if (readMatrix[m(i,j)].values.daysOfInfection < 7)
-                {
-                    writeMatrix[m(i,j)].values.daysOfIncubation = 0;
-                    ++writeMatrix[m(i,j)].values.daysOfInfection;
-                }
-                else if (rand()%100 < immunityPercentage)
-                {
-                    writeMatrix[m(i,j)].values.isInfected = false;
-                    writeMatrix[m(i,j)].values.isImmune = true;
-                }
-                
-                if (readMatrix[m(i,j)].values.age >= 65)
-                {
-                    if (rand()%100 < deathPercentage)
-                    {
-                        writeMatrix[m(i,j)].values.isInfected = false;
-                        writeMatrix[m(i,j)].values.isDead = true;
-                    }
-                }
-                else if (readMatrix[m(i,j)].values.age > 25 && readMatrix[m(i,j)].values.age < 65)
-                {
-                    if (rand()%200 < deathPercentage)
-                    {
-                        writeMatrix[m(i,j)].values.isInfected = false;
-                        writeMatrix[m(i,j)].values.isDead = true;
-                    }
-                }
-                else
-                {
-                    if (rand()%400 < deathPercentage / 4)
-                    {
-                        writeMatrix[m(i,j)].values.isInfected = false;
-                        writeMatrix[m(i,j)].values.isDead = true;
-                    }
-                }
-            }
-            else // if the person is not infected
-            {
-                if (infectedNeighbours > 0 &&
-                    rand()%100 < infectionPercentage * infectedNeighbours &&
-                    readMatrix[m(i,j)].values.isImmune == false)
-                {
-                    writeMatrix[m(i,j)].values.isInfected = true;
-                    continue;
-                }
+    #ifdef usingCompactState
+        MPI_Type_free(&stateColumnType);
+    #endif //usingCompactState
+}
 
-                if (rand()%100000 < vaccinationPercentage)
-                {
-                    writeMatrix[m(i,j)].values.isVaccinated = true;
-                    continue;
-                }
+// moves the strip boundaries towards the ranks that updated their columns faster since the last call
+inline void rebalance()
+{
+    std::vector<double> seconds(size);
+    MPI_Allgather(&updateSeconds, 1, MPI_DOUBLE, seconds.data(), 1, MPI_DOUBLE, comm);
+    updateSeconds = 0;
 
-                if (vaccinatedNeighbours > 0 &&
-                    rand()%250 < vaccinationPercentage * vaccinatedNeighbours)
-                {
-                    writeMatrix[m(i,j)].values.isVaccinated = true;
-                    continue;
-                }
+    std::vector<int> widths = balancedSizes(stripCols, seconds, 2);
 
-                if(rand()%100 < loseImmunityPercentage)
-                {
-                    writeMatrix[m(i,j)].values.isImmune = false;
-                    continue;
-                }
-            }
-        }
+    if (widths == stripCols) return;
+
+    std::vector<Block> before(size), after(size);
+    std::vector<int> oldOffsets = offsetsOf(stripCols), newOffsets = offsetsOf(widths);
+
+    for (int r = 0; r < size; ++r)
+    {
+        before[r] = {0, oldOffsets[r], rows, stripCols[r]};
+        after[r] = {0, newOffsets[r], rows, widths[r]};
     }
+
+    Grid<layout> oldLocal = local;
+    Person * oldMatrix = readMatrix;
+
+    delete [] writeMatrix;
+
+    #ifdef usingCompactState
+        uint8_t * oldAges = ages;
+        CompactPerson * oldState = readState;
+
+        delete [] writeState;
+    #endif //usingCompactState
+
+    freeTypes();
+    split(widths);
+    createTypes();
+
+    // only the current generation moves, the halos come with the next exchange
+    #ifdef usingCompactState
+        redistribute(comm, before, after, 0, 1, oldLocal, oldAges, local, ages, MPI_BYTE);
+        redistribute(comm, before, after, 0, 1, oldLocal, oldState, local, readState, MPI_BYTE);
+
+        delete [] oldAges;
+        delete [] oldState;
+    #else
+        redistribute(comm, before, after, 0, 1, oldLocal, oldMatrix, local, readMatrix, personType());
+    #endif //usingCompactState
+
+    delete [] oldMatrix;
 }
 
-inline void updateBorders()
+inline void initialize()
 {
-    for(int i = 0; i < rows; i++)
+    if (!settings.getPopulationFile().empty())
     {
-        for(int j = 1; j < cols/procs + 1; j += cols / procs - 1)
-        {
-            short infectedNeighbours = 0;
-            short vaccinatedNeighbours = 0;
+        // each rank reads only its own strip of columns
+        std::vector<uint16_t> block;
+        readPopulationBlock(settings.getPopulationFile(), comm, rows, cols, 0, firstColumn, rows, localCols, block);
 
-            for(int k = -1; k <= 1; ++k)
-            {
-                for(int l = -1; l <= 1; ++l)
-                {
-                    // if the neighbour is not the person itself
-                    if(k != 0 || l != 0)
-                    {
-                        // if the neighbour is infected
-                        if(readMatrix[m((i + k + rows) % rows, ((j + l + cols) % cols))].values.isInfected == true &&
-                           readMatrix[m((i + k + rows) % rows, ((j + l + cols) % cols))].values.daysOfIncubation >= 2)
-                        {
-                            ++infectedNeighbours;
-                        }
-
-                        // if the neighbour is vaccinated
-                        if(readMatrix[m((i + k + rows) % rows, ((j + l + cols) % cols))].values.isVaccinated == true)
-                        {
-                            ++vaccinatedNeighbours;
-                        }
-                    }
-                }
-            }
+        for (int i = 0; i < rows; ++i)
+            for (int j = 1; j < localCols + 1; ++j)
+                readMatrix[m(i,j)] = decodePopulationCell(block[i * localCols + j - 1]);
 
-            // copy the person to the write matrix
-            writeMatrix[m(i,j)] = readMatrix[m(i,j)];
+        return;
+    }
 
-            if (readMatrix[m(i,j)].values.isDead || readMatrix[m(i,j)].values.isVaccinated)
-                continue;
-            
-            // if the person is infected
-            if (readMatrix[m(i,j)].values.isInfected && !readMatrix[(i,j)].values.isImmune)
-            {
+    uint64_t seed = populationSeed(settings.getSeed(), ensemble.group);
 
-                if (readMatrix[m(i,j)].values.daysOfIncubation < 3)
-                {
-                    ++writeMatrix[m(i,j)].values.daysOfIncubation;
-                    continue;
-                }
-                
-                if (readMatrix[m(i,j)].values.daysOfInfection < 7)
-                {
-                    writeMatrix[m(i,j)].values.daysOfIncubation = 0;
-                    ++writeMatrix[m(i,j)].values.daysOfInfection;
-                }
-                else if (rand()%100 < immunityPercentage)
-                {
-                    writeMatrix[m(i,j)].values.isInfected = false;
-                    writeMatrix[m(i,j)].values.isImmune = true;
-                }
-                
-                if (readMatrix[m(i,j)].values.age >= 65)
-                {
-                    if (rand()%100 < deathPercentage)
-                    {
-                        writeMatrix[m(i,j)].values.isInfected = false;
-                        writeMatrix[m(i,j)].values.isDead = true;
-                    }
-                }
-                else if (readMatrix[m(i,j)].values.age > 25 && readMatrix[m(i,j)].values.age < 65)
-                {
-                    if (rand()%100 < deathPercentage / 2)
-                    {
-                        writeMatrix[m(i,j)].values.isInfected = false;
-                        writeMatrix[m(i,j)].values.isDead = true;
-                    }
-                }
-                else
-                {
-                    if (rand()%100 < deathPercentage / 4)
-                    {
-                        writeMatrix[m(i,j)].values.isInfected = false;
-                        writeMatrix[m(i,j)].values.isDead = true;
-                    }
-                }
-            }
-            else // if the person is not infected
-            {
-                if (infectedNeighbours > 0 &&
-                    rand()%100 < infectionPercentage * infectedNeighbours &&
-                    readMatrix[m(i,j)].values.isImmune == false)
-                {
-                    writeMatrix[m(i,j)].values.isInfected = true;
-                    continue;
-                }
+    for (int i = 0; i < rows; ++i)
+        for (int j = 1; j < localCols + 1; ++j)
+            readMatrix[m(i,j)] = generatedPerson(seed, i, firstColumn + j - 1);
 
-                if (rand()%100000 < vaccinationPercentage)
-                {
-                    writeMatrix[m(i,j)].values.isVaccinated = true;
-                    continue;
-                }
+    // every seed goes to the rank owning its column
+    std::vector<int> offsets = offsetsOf(stripCols);
 
-                if (vaccinatedNeighbours > 0 &&
-                    rand()%250 < vaccinationPercentage * vaccinatedNeighbours)
-                {
-                    writeMatrix[m(i,j)].values.isVaccinated = true;
-                    continue;
-                }
+    std::vector<OutbreakSeed> seeds = scatterOutbreak(settings, rows, cols, comm, [&offsets](int, int col)
+    {
+        return (int) (std::upper_bound(offsets.begin(), offsets.end(), col) - offsets.begin()) - 1;
+    });
 
-                if(rand()%100 < loseImmunityPercentage)
-                {
-                    writeMatrix[m(i,j)].values.isImmune = false;
-                    continue;
-                }
-            }
-        }
-    }
+    for (OutbreakSeed seed : seeds)
+        readMatrix[m(seed.row, seed.col - firstColumn + 1)].values.isInfected = 1;
 }
 
+inline void finalize()
+{
+    freeTypes();
+
+    #ifdef usingCompactState
+        delete compactStates;
+        delete transitions;
+
+        delete [] ages;
+        delete [] readState;
+        delete [] writeState;
+    #endif //usingCompactState
+
+    delete [] readMatrix;
+    delete [] writeMatrix;
+
+    MPI_Comm_free(&comm);
+    freeEnsemble(ensemble);
+
+    MPI_Finalize();
+}
+
+// columns [firstColumn, lastColumn), rows wrap around
+inline void update(int firstColumn, int lastColumn)
+{
+    updateStencil(local, 0, rows, firstColumn, lastColumn,
+        [](int i, int j) -> const Person & {return readMatrix[m(i < 0 ? i + rows : i >= rows ? i - rows : i, j)];},
+        [](int i, int j) -> Person & {return writeMatrix[m(i,j)];},
+        cascade(rules, vaccinations));
+}
+
+#ifdef usingCompactState
+
+// columns [firstColumn, lastColumn) of the compact states
+inline void updateCompactState(int firstColumn, int lastColumn)
+{
+    updateStencil(local, 0, rows, firstColumn, lastColumn,
+        [](int i, int j) -> const CompactPerson & {return readState[m(i < 0 ? i + rows : i >= rows ? i - rows : i, j)];},
+        [](int i, int j) -> CompactPerson & {return writeState[m(i,j)];},
+        [](CompactPerson person, int i, int j, short infectedNeighbours, short vaccinatedNeighbours)
+        {
+            return compactStates->next(person, ages[m(i,j)], infectedNeighbours, vaccinatedNeighbours, vaccinations);
+        });
+}
+
+// splits the initial people in ages and compact states
+inline void compactPeople()
+{
+    local.forEach(0, rows, 1, localCols + 1, [](int i, int j)
+    {
+        ages[m(i,j)] = readMatrix[m(i,j)].values.age;
+        readState[m(i,j)] = compactStates->encode(readMatrix[m(i,j)]);
+    });
+}
+
+// rebuilds readMatrix out of the compact states for drawing
+inline void expandPeople()
+{
+    local.forEach(0, rows, 1, localCols + 1, [](int i, int j)
+    {
+        readMatrix[m(i,j)] = compactStates->decode(readState[m(i,j)], ages[m(i,j)]);
+    });
+}
+
+#endif //usingCompactState
+
 inline void sendBorders()
 {
-    MPI_Request request;
+    #ifdef usingCompactState
+
+        // one byte per person instead of a whole Person
+        MPI_Isend(&readState[m(0, 1)], 1, stateColumnType, left, 0, comm, &borderRequests[0]);
+        MPI_Isend(&readState[m(0, localCols)], 1, stateColumnType, right, 1, comm, &borderRequests[1]);
+
+    #else
 
-    // send column to the left
-    MPI_Isend(&readMatrix[m(0, 1)], 2, columnType, left, 0, comm, &request);
+        // send column to the left
+        MPI_Isend(&readMatrix[m(0, 1)], 1, columnType, left, 0, comm, &borderRequests[0]);
 
-    // send column to the right
-    MPI_Isend(&readMatrix[m(0, cols/procs)], 2, columnType, right, 1, comm, &request);
+        // send column to the right
+        MPI_Isend(&readMatrix[m(0, localCols)], 1, columnType, right, 1, comm, &borderRequests[1]);
+
+    #endif //usingCompactState
 }
 
 inline void receiveBorders()
 {
-    // receive column from the left
-    MPI_Recv(&readMatrix[m(0, 0)], 2, columnType, left, 1, comm, MPI_STATUS_IGNORE);
+    #ifdef usingCompactState
+
+        MPI_Recv(&readState[m(0, 0)], 1, stateColumnType, left, 1, comm, MPI_STATUS_IGNORE);
+        MPI_Recv(&readState[m(0, localCols + 1)], 1, stateColumnType, right, 0, comm, MPI_STATUS_IGNORE);
+
+    #else
+
+        // receive column from the left
+        MPI_Recv(&readMatrix[m(0, 0)], 1, columnType, left, 1, comm, MPI_STATUS_IGNORE);
+
+        // receive column from the right
+        MPI_Recv(&readMatrix[m(0, localCols + 1)], 1, columnType, right, 0, comm, MPI_STATUS_IGNORE);
+
+    #endif //usingCompactState
 
-    // receive column from the right
-    MPI_Recv(&readMatrix[m(0, cols/procs + 1)], 2, columnType, right, 0, comm, MPI_STATUS_IGNORE);
+    // the read buffer becomes the write buffer after the swap
+    MPI_Waitall(2, borderRequests, MPI_STATUSES_IGNORE);
 }
 
 #ifdef usingGraphics
-inline void draw(Person * readMatrix)
+// draws the people of block, received from its owner in a grid of their own
+inline void draw(Person * people, const Block & block)
 {
-    al_clear_to_color(defaultPersonColor);
+    Grid<layout> frame(block.rows, block.cols);
 
-    for (int j = 0; j < rows; ++j)
+    for (int j = 0; j < block.cols; ++j)
     {
-        for (int i = 0; i < cols; ++i)
+        for (int i = 0; i < block.rows; ++i)
         {
-            if (readMatrix[m(i,j)].values.isInfected && readMatrix[m(i,j)].values.daysOfIncubation < 3)
+            Person person = people[frame.index(i,j)];
+
+            int x = (block.firstCol + j) * square;
+            int y = (block.firstRow + i) * square;
+
+            if (person.values.isInfected && person.values.daysOfIncubation < 3)
             {
-                al_draw_filled_rectangle(j * square, i * square, (j + 1) * square, (i + 1) * square, incubationColor);
+                al_draw_filled_rectangle(x, y, x + square, y + square, incubationColor);
             }
-            else if (readMatrix[m(i,j)].values.isInfected)
+            else if (person.values.isInfected)
             {
-                al_draw_filled_rectangle(j * square, i * square, (j + 1) * square, (i + 1) * square, infectedColor);
+                al_draw_filled_rectangle(x, y, x + square, y + square, infectedColor);
             }
-            else if (readMatrix[m(i,j)].values.isImmune)
+            else if (person.values.isImmune)
             {
-                al_draw_filled_rectangle(j * square, i * square, (j + 1) * square, (i + 1) * square, immuneColor);
+                al_draw_filled_rectangle(x, y, x + square, y + square, immuneColor);
             }
-            else if (readMatrix[m(i,j)].values.isDead)
+            else if (person.values.isDead)
             {
-                al_draw_filled_rectangle(j * square, i * square, (j + 1) * square, (i + 1) * square, deadColor);
+                al_draw_filled_rectangle(x, y, x + square, y + square, deadColor);
             }
-            else if (readMatrix[m(i,j)].values.isVaccinated)
+            else if (person.values.isVaccinated)
             {
-                al_draw_filled_rectangle(j * square, i * square, (j + 1) * square, (i + 1) * square, vaccinatedColor);
+                al_draw_filled_rectangle(x, y, x + square, y + square, vaccinatedColor);
             }
             else 
             {
-                al_draw_filled_rectangle(j * square, i * square, (j + 1) * square, (i + 1) * square, defaultPersonColor);
+                al_draw_filled_rectangle(x, y, x + square, y + square, defaultPersonColor);
             }
 
             // add black layer that scales with person age
-            al_draw_filled_rectangle(j * square, i * square, (j + 1) * square, (i + 1) * square, al_map_rgba(0, 0, 0, readMatrix[m(i,j)].values.age));
+            al_draw_filled_rectangle(x, y, x + square, y + square, al_map_rgba(0, 0, 0, person.values.age));
         }
     }
+}
+#endif //usingGraphics
 
-    /* // draw a grid with procs columns
-    for (int i = 0; i < procs; ++i)
+inline void countGeneration(int generation)
+{
+    local.forEach(0, rows, 1, localCols + 1, [generation](int i, int j)
     {
-        al_draw_line(i * cols/procs * square, 0, i * cols/procs * square, rows * square, al_map_rgb(255, 0, 0), 2);
-    } */
-
-
-    al_flip_display();
+        #ifdef usingCompactState
+            statistics->count(generation, compactStates->decode(readState[m(i,j)], ages[m(i,j)]));
+        #else
+            statistics->count(generation, readMatrix[m(i,j)]);
+        #endif //usingCompactState
+    });
 }
-#endif //usingGraphics
 
 inline void swap()
 {
-    Person * tmp;
-    tmp = readMatrix;
-    readMatrix = writeMatrix;
-    writeMatrix = tmp;
+    #ifdef usingCompactState
+
+        CompactPerson * tmp;
+        tmp = readState;
+        readState = writeState;
+        writeState = tmp;
+
+    #else
+
+        Person * tmp;
+        tmp = readMatrix;
+        readMatrix = writeMatrix;
+        writeMatrix = tmp;
+
+    #endif //usingCompactState
 }
\ No newline at end of file
@@ -0,0 +1,193 @@
+#include <mpich/mpi.h>
+#include "../headers/Settings.hpp"
+#include "../headers/Person.hpp"
+#include "../headers/Rules.hpp"
+#include "../headers/PopulationLoader.hpp"
+#include "../headers/Outbreak.hpp"
+#include "../headers/Ensemble.hpp"
+#include "../headers/BatchedKernel.hpp"
+#include "../headers/GeometricSkip.hpp"
+
+// Every rank advances `replicas` independent copies of the whole grid in one sweep (see
+// BatchedKernel.hpp) and the mean and variance curves over all of them are written like in an
+// ensemble run, with ranks split in groups of one and points of ensembleReplicas ranks.
+// There is nothing to draw, so this build has no graphics.
+
+#define debug
+
+// replicas per rank, interleaved in memory
+#define replicas 8
+
+
+Settings settings;
+
+int rows;
+int cols;
+
+int numberOfGenerations;
+
+Rules rules;
+
+// spontaneous vaccinations, drawn as gaps between hits instead of one roll per person
+GeometricSkip vaccinations;
+
+Person * readMatrix;
+Person * writeMatrix;
+
+Ensemble ensemble;
+EnsembleStatistics * statistics;
+int worldRank;
+
+#ifdef debug
+    double startTime, endTime, totalTime;
+#endif //debug
+
+
+
+
+
+
+
+
+void loadSettings(int argc, char * argv[]);
+void allocate();
+void initialize();
+inline void swap();
+void countGeneration(int generation);
+void finalize();
+inline size_t m(int i, int j, int r);
+
+
+
+
+int main(int argc, char * argv[])
+{
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &worldRank);
+
+    loadSettings(argc, argv);
+
+    #ifdef debug
+        startTime = MPI_Wtime();
+    #endif //debug
+
+    srand(settings.getSeed() + worldRank);
+
+    allocate();
+    initialize();
+
+    statistics = new EnsembleStatistics(numberOfGenerations, replicas);
+    countGeneration(0);
+
+    for (int i = 1; i <= numberOfGenerations; i++)
+    {
+        updateBatched<replicas>(readMatrix, writeMatrix, rows, cols, rules, vaccinations);
+
+        swap();
+
+        countGeneration(i);
+    }
+
+    #ifdef debug
+        endTime = MPI_Wtime();
+        totalTime = endTime - startTime;
+
+        if (worldRank == 0)
+        {
+            double updates = (double) rows * cols * replicas * numberOfGenerations;
+            printf("Total time: %f\n", totalTime);
+            printf("Person updates per second per rank: %.0f\n", updates / totalTime);
+        }
+    #endif //debug
+
+    statistics->write(ensemble, settings.getEnsembleOutput());
+
+    finalize();
+
+}
+
+
+
+void loadSettings(int argc, char * argv[])
+{
+    settings = Settings::load(argc, argv, MPI_COMM_WORLD);
+
+    // every rank is a group of its own, its replicas live in its memory
+    ensemble = splitEnsemble(settings, MPI_COMM_WORLD, 1);
+
+    rows = settings.getRows();
+    cols = settings.getCols();
+
+    numberOfGenerations = settings.getNumberOfGenerations();
+
+    rules = rulesFrom(settings);
+    vaccinations = spontaneousVaccinations(rules);
+}
+
+void allocate()
+{
+    readMatrix = new Person[(size_t) rows * cols * replicas];
+    writeMatrix = new Person[(size_t) rows * cols * replicas];
+}
+
+void initialize()
+{
+    if (!settings.getPopulationFile().empty())
+    {
+        MappedPopulation population(settings.getPopulationFile(), rows, cols);
+
+        for (int i = 0; i < rows; ++i)
+            for (int j = 0; j < cols; ++j)
+                for (int r = 0; r < replicas; ++r)
+                    readMatrix[m(i,j,r)] = decodePopulationCell(population.at(i,j));
+
+        return;
+    }
+
+    // replica r of this rank is replica group * replicas + r of the whole ensemble
+    for (int r = 0; r < replicas; ++r)
+    {
+        uint64_t seed = populationSeed(settings.getSeed(), ensemble.group * replicas + r);
+
+        for (int i = 0; i < rows; ++i)
+            for (int j = 0; j < cols; ++j)
+                readMatrix[m(i,j,r)] = generatedPerson(seed, i, j);
+    }
+
+    // every replica starts from the same outbreak
+    for (OutbreakSeed seed : outbreakSeeds(settings, rows, cols))
+        for (int r = 0; r < replicas; ++r)
+            readMatrix[m(seed.row, seed.col, r)].values.isInfected = 1;
+}
+
+inline void swap(){
+    Person * tmp;
+    tmp = readMatrix;
+    readMatrix = writeMatrix;
+    writeMatrix = tmp;
+}
+
+void countGeneration(int generation)
+{
+    for (int i = 0; i < rows; ++i)
+        for (int j = 0; j < cols; ++j)
+            for (int r = 0; r < replicas; ++r)
+                statistics->count(generation, readMatrix[m(i,j,r)], r);
+}
+
+void finalize()
+{
+    delete statistics;
+
+    delete [] readMatrix;
+    delete [] writeMatrix;
+
+    freeEnsemble(ensemble);
+
+    MPI_Finalize();
+}
+
+inline size_t m(int i, int j, int r)
+{
+    return batchedIndex<replicas>(i, j, r, cols);
+}
@@ -0,0 +1,140 @@
+#ifndef BALANCE_HPP
+#define BALANCE_HPP
+
+#include <algorithm> // max, max_element
+#include <cmath> // floor
+#include <vector> // vector
+
+#include <mpich/mpi.h>
+#include "Grid.hpp"
+
+// Load balancing --------------------------------------------------------------------------------------
+//
+// The cost of a person depends on its state: infected people go through every roll while dead and
+// vaccinated ones are skipped right away, so equal strips or blocks don't take equal time. Every
+// rebalanceInterval generations the parallel builds share how long each rank spent updating and
+// resize the parts of each split dimension in proportion to how fast they went, then move the people
+// that changed owner with one MPI_Alltoallw whose types are the overlaps of the old and new blocks.
+// -----------------------------------------------------------------------------------------------------
+
+// total split in parts as equal as possible, the first total % parts get one more
+inline std::vector<int> evenSizes(int total, int parts)
+{
+    std::vector<int> sizes(parts, total / parts);
+
+    for (int p = 0; p < total % parts; ++p) ++sizes[p];
+
+    return sizes;
+}
+
+// where each part starts
+inline std::vector<int> offsetsOf(const std::vector<int> & sizes)
+{
+    std::vector<int> offsets(sizes.size(), 0);
+
+    for (size_t p = 1; p < sizes.size(); ++p) offsets[p] = offsets[p - 1] + sizes[p - 1];
+
+    return offsets;
+}
+
+// New sizes of parts that took seconds to update sizes people each. Every part is moved halfway
+// towards a share of the total proportional to its speed, so a noisy measure can't make the split
+// oscillate, and never gets below minimum.
+inline std::vector<int> balancedSizes(const std::vector<int> & sizes, const std::vector<double> & seconds, int minimum)
+{
+    int parts = sizes.size();
+    int total = 0;
+    double speed = 0;
+
+    for (int p = 0; p < parts; ++p)
+    {
+        total += sizes[p];
+        speed += sizes[p] / std::max(seconds[p], 1e-9);
+    }
+
+    std::vector<int> balanced(parts);
+    std::vector<double> remainders(parts);
+    int assigned = 0;
+
+    for (int p = 0; p < parts; ++p)
+    {
+        double target = total * (sizes[p] / std::max(seconds[p], 1e-9)) / speed;
+        double wanted = std::max((double) minimum, (sizes[p] + target) / 2);
+
+        balanced[p] = (int) floor(wanted);
+        remainders[p] = wanted - balanced[p];
+        assigned += balanced[p];
+    }
+
+    // rounding leftovers go to the largest remainders, an excess is taken from the largest parts
+    while (assigned < total)
+    {
+        int p = std::max_element(remainders.begin(), remainders.end()) - remainders.begin();
+        ++balanced[p];
+        remainders[p] = -1;
+        ++assigned;
+    }
+
+    while (assigned > total)
+    {
+        int p = std::max_element(balanced.begin(), balanced.end()) - balanced.begin();
+        --balanced[p];
+        --assigned;
+    }
+
+    return balanced;
+}
+
+inline bool overlap(const Block & a, const Block & b, Block & common)
+{
+    common.firstRow = std::max(a.firstRow, b.firstRow);
+    common.firstCol = std::max(a.firstCol, b.firstCol);
+    common.rows = std::min(a.firstRow + a.rows, b.firstRow + b.rows) - common.firstRow;
+    common.cols = std::min(a.firstCol + a.cols, b.firstCol + b.cols) - common.firstCol;
+
+    return common.rows > 0 && common.cols > 0;
+}
+
+// Moves what every rank holds for each person from its block in before to its block in after, one
+// element a person. Owned people sit haloRows and haloCols away from the start of the local grids.
+template <typename Layout, typename T>
+void redistribute(MPI_Comm comm, const std::vector<Block> & before, const std::vector<Block> & after, int haloRows, int haloCols,
+                  const Grid<Layout> & oldLocal, const T * oldData, const Grid<Layout> & newLocal, T * newData, MPI_Datatype element)
+{
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    std::vector<int> sendCounts(size, 0), receiveCounts(size, 0), displacements(size, 0);
+    std::vector<MPI_Datatype> sendTypes(size, element), receiveTypes(size, element);
+
+    for (int r = 0; r < size; ++r)
+    {
+        Block common;
+
+        if (overlap(before[rank], after[r], common))
+        {
+            oldLocal.blockType(common.firstRow - before[rank].firstRow + haloRows, common.firstCol - before[rank].firstCol + haloCols,
+                               common.rows, common.cols, element, &sendTypes[r]);
+            sendCounts[r] = 1;
+        }
+
+        if (overlap(after[rank], before[r], common))
+        {
+            newLocal.blockType(common.firstRow - after[rank].firstRow + haloRows, common.firstCol - after[rank].firstCol + haloCols,
+                               common.rows, common.cols, element, &receiveTypes[r]);
+            receiveCounts[r] = 1;
+        }
+    }
+
+    MPI_Alltoallw(oldData, sendCounts.data(), displacements.data(), sendTypes.data(),
+                  newData, receiveCounts.data(), displacements.data(), receiveTypes.data(), comm);
+
+    for (int r = 0; r < size; ++r)
+    {
+        if (sendCounts[r]) MPI_Type_free(&sendTypes[r]);
+        if (receiveCounts[r]) MPI_Type_free(&receiveTypes[r]);
+    }
+}
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef BATCHED_KERNEL_HPP
+#define BATCHED_KERNEL_HPP
+
+#include <cstddef> // size_t
+
+#include "Person.hpp"
+#include "Rules.hpp"
+
+// Batched replicas ------------------------------------------------------------------------------------
+//
+// K independent grids stored interleaved, Person[cell][K]: the K copies of a cell are contiguous so a
+// single sweep computes the wrapped neighbour offsets of a cell once and then walks 8 runs of K people
+// instead of 8 scattered ones per replica. With small grids this turns K latency bound passes into one
+// bandwidth bound pass.
+//
+// Cells are row-major with periodic borders, like the sequential build.
+// -----------------------------------------------------------------------------------------------------
+
+template <int K>
+inline size_t batchedIndex(int i, int j, int replica, int cols)
+{
+    return ((size_t) i * cols + j) * K + replica;
+}
+
+// advances the K replicas of read by one generation into write, vaccinated() as in nextPerson()
+template <int K, typename Vaccinated>
+inline void updateBatched(const Person * read, Person * write, int rows, int cols, const Rules & rules, Vaccinated && vaccinated)
+{
+    for (int i = 0; i < rows; ++i)
+    {
+        size_t above = (size_t) ((i - 1 + rows) % rows) * cols;
+        size_t here = (size_t) i * cols;
+        size_t below = (size_t) ((i + 1) % rows) * cols;
+
+        for (int j = 0; j < cols; ++j)
+        {
+            size_t left = (j - 1 + cols) % cols;
+            size_t right = (j + 1) % cols;
+
+            const size_t neighbours[8] = {
+                (above + left) * K, (above + j) * K, (above + right) * K,
+                (here + left) * K,                   (here + right) * K,
+                (below + left) * K, (below + j) * K, (below + right) * K
+            };
+
+            short infectedNeighbours[K] = {0};
+            short vaccinatedNeighbours[K] = {0};
+
+            for (int n = 0; n < 8; ++n)
+            {
+                const Person * neighbour = read + neighbours[n];
+
+                for (int r = 0; r < K; ++r)
+                {
+                    infectedNeighbours[r] += isInfectious(neighbour[r]);
+                    vaccinatedNeighbours[r] += neighbour[r].values.isVaccinated;
+                }
+            }
+
+            const Person * self = read + (here + j) * K;
+            Person * next = write + (here + j) * K;
+
+            for (int r = 0; r < K; ++r)
+                next[r] = nextPerson(self[r], infectedNeighbours[r], vaccinatedNeighbours[r], rules, vaccinated);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef COLUMN_SUMS_HPP
+#define COLUMN_SUMS_HPP
+
+#include "Person.hpp"
+#include "Rules.hpp"
+
+// Column sum neighbour counting -----------------------------------------------------------------------
+//
+// Sweeps a region line by line keeping, for the previous, current and next position of the line, how
+// many infectious and vaccinated people there are in that position across lines line - 1, line and
+// line + 1. The counts of a person are the sum of the three minus the person itself, so every step
+// reads 3 new people instead of the 8 neighbours.
+//
+// Lines are the outer loop and positions the inner one, so callers pick which index is a line to make
+// positions contiguous in memory: rows for the row-major sequential build, columns for the
+// column-major parallel ones. The stencil is symmetric so the counts are the same either way.
+//
+//      at(line, position) -> a Person or anything else with isInfectious() and isVaccinated()
+//                            overloads, also called one line and one position outside the region
+//      update(line, position, infectedNeighbours, vaccinatedNeighbours)
+// -----------------------------------------------------------------------------------------------------
+
+template <typename At>
+inline void columnSum(At & at, int line, int position, short & infected, short & vaccinated)
+{
+    const auto & before = at(line - 1, position);
+    const auto & here = at(line, position);
+    const auto & after = at(line + 1, position);
+
+    infected = isInfectious(before) + isInfectious(here) + isInfectious(after);
+    vaccinated = isVaccinated(before) + isVaccinated(here) + isVaccinated(after);
+}
+
+// lines [firstLine, lastLine) and positions [firstPosition, lastPosition)
+template <typename At, typename Update>
+inline void columnSumSweep(int firstLine, int lastLine, int firstPosition, int lastPosition, At at, Update update)
+{
+    for (int line = firstLine; line < lastLine; ++line)
+    {
+        // previous, current and next position
+        short infected[3];
+        short vaccinated[3];
+
+        columnSum(at, line, firstPosition - 1, infected[0], vaccinated[0]);
+        columnSum(at, line, firstPosition, infected[1], vaccinated[1]);
+
+        for (int position = firstPosition; position < lastPosition; ++position)
+        {
+            columnSum(at, line, position + 1, infected[2], vaccinated[2]);
+
+            const auto & self = at(line, position);
+
+            update(line, position,
+                   (short) (infected[0] + infected[1] + infected[2] - isInfectious(self)),
+                   (short) (vaccinated[0] + vaccinated[1] + vaccinated[2] - isVaccinated(self)));
+
+            infected[0] = infected[1];
+            infected[1] = infected[2];
+            vaccinated[0] = vaccinated[1];
+            vaccinated[1] = vaccinated[2];
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef COMPACT_STATE_HPP
+#define COMPACT_STATE_HPP
+
+#include <cstdint> // uint8_t
+
+#include "Person.hpp"
+#include "TransitionTable.hpp"
+
+// Compact state ---------------------------------------------------------------------------------------
+//
+// age never changes after initialize(), so it can live in its own read-only array while only the
+// evolving part of a person is double buffered and exchanged. That part takes 9 bits in Person but
+// fits a byte: dead and vaccinated people never change again, so their day counters can be dropped.
+//
+//      live people         0 | infection (3) | incubation (2) | immune | infected
+//      dead or vaccinated  1 | 000 | vaccinated | dead | immune | infected
+//
+// With this layout the two flags neighbours look at are plain bit tests.
+// -----------------------------------------------------------------------------------------------------
+
+#define compactTerminal 0x80
+
+struct CompactPerson
+{
+    uint8_t code;
+};
+
+// infected, live and past the second day of incubation
+inline bool isInfectious(CompactPerson person) {return (person.code & 0x89) == 0x09;}
+
+inline bool isVaccinated(CompactPerson person) {return (person.code & 0x88) == 0x88;}
+
+class CompactStates
+{
+    private:
+
+        const TransitionTable & transitions;
+
+        // between the compact states of TransitionTable and the codes above
+        uint8_t codes[transitionStates];
+        uint16_t states[256];
+
+    public:
+
+        CompactStates(const TransitionTable & transitions);
+
+        inline CompactPerson encode(const Person & person) const
+        {
+            CompactPerson compact = {codes[TransitionTable::encode(person)]};
+            return compact;
+        }
+
+        inline Person decode(CompactPerson person, int age) const
+        {
+            return transitions.decode(states[person.code], age);
+        }
+
+        // same contract as nextPerson(), the age comes from the read-only array
+        template <typename Vaccinated>
+        inline CompactPerson next(CompactPerson person, int age, short infectedNeighbours, short vaccinatedNeighbours, Vaccinated && vaccinated) const
+        {
+            int band = (age > 25) + (age >= 65);
+
+            CompactPerson next = {codes[transitions.nextState(band, states[person.code], infectedNeighbours, vaccinatedNeighbours, vaccinated)]};
+            return next;
+        }
+
+};
+
+inline CompactStates::CompactStates(const TransitionTable & transitions) : transitions(transitions)
+{
+    for (int state = 0; state < transitionStates; ++state)
+    {
+        if (state & (stateDead | stateVaccinated))
+        {
+            codes[state] = compactTerminal | (state & (stateInfected | stateImmune | stateDead | stateVaccinated));
+        }
+        else
+        {
+            codes[state] = (state & (stateInfected | stateImmune)) |
+                           ((state & stateIncubation) >> stateIncubationShift) << 2 |
+                           ((state & stateInfection) >> stateInfectionShift) << 4;
+        }
+    }
+
+    // every code goes back to the state with its days cleared, which is what it was built from
+    for (int code = 0; code < 256; ++code) states[code] = 0;
+
+    for (int state = transitionStates - 1; state >= 0; --state) states[codes[state]] = state;
+}
+
+#endif
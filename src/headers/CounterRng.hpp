@@ -0,0 +1,43 @@
+#ifndef COUNTER_RNG_HPP
+#define COUNTER_RNG_HPP
+
+#include <cstdint> // uint64_t, uint32_t
+
+// Counter based random numbers ------------------------------------------------------------------------
+//
+// rand() hands out the next number of one global stream, so what happens to a person depends on how
+// many people were updated before it. A CounterRandom is a pure function of a seed, the generation,
+// the position of the person and how many numbers it already drew for that person: updating the same
+// person twice, in any order and on any rank, rolls the same dice. Tiles that recompute people owned
+// by their neighbours (see temporal blocking in the sequential build) rely on that.
+//
+// Drop-in for rand() in the kernels: random() returns a non-negative int below 2^31.
+// -----------------------------------------------------------------------------------------------------
+
+// splitmix64 finalizer
+inline uint64_t counterHash(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+struct CounterRandom
+{
+    uint64_t key;
+    uint32_t counter;
+
+    CounterRandom(uint64_t seed, int generation, int i, int j) : counter(0)
+    {
+        uint64_t position = (uint64_t) (uint32_t) i << 32 | (uint32_t) j;
+        key = counterHash(seed ^ counterHash((uint64_t) (uint32_t) generation ^ counterHash(position)));
+    }
+
+    inline int operator()()
+    {
+        return (int) (counterHash(key + counter++) >> 33);
+    }
+};
+
+#endif
@@ -0,0 +1,181 @@
+#ifndef ENSEMBLE_HPP
+#define ENSEMBLE_HPP
+
+#include <cstdio> // FILE, fprintf
+#include <string> // string
+#include <vector> // vector
+#include <stdexcept> // invalid_argument
+
+#include <mpich/mpi.h>
+#include "Settings.hpp"
+#include "Person.hpp"
+
+// Ensemble runs ---------------------------------------------------------------------------------------
+//
+// MPI_COMM_WORLD is split in groups of ensembleGroupSize ranks, every group runs its own replica with
+// the usual decomposition on its own communicator. Groups are assigned to parameter points in blocks
+// of ensembleReplicas: point p runs with ensembleSweepField increased by p * ensembleSweepStep.
+//
+// Every replica keeps its per generation state counts in memory, at the end they are summed inside the
+// group and then reduced over the replicas of each point, so the root of a point writes mean and
+// variance curves to <ensembleOutput>-point<p>.csv without any per replica file. A rank running
+// several batched replicas keeps one set of counts for each of them.
+// -----------------------------------------------------------------------------------------------------
+
+#define ensembleStates 4 // infected, immune, dead, vaccinated
+
+struct Ensemble
+{
+    // this replica and how many there are
+    int group;
+    int groups;
+
+    // parameter point of this replica and how many there are
+    int point;
+    int points;
+
+    // ranks running this replica
+    MPI_Comm comm;
+
+    // roots of the replicas of the same point, MPI_COMM_NULL on every other rank
+    MPI_Comm pointComm;
+
+    // value of the swept parameter for this point
+    int sweepValue;
+};
+
+// Splits world and applies the parameter sweep of this group to settings, groupSize overrides
+// ensembleGroupSize when positive
+inline Ensemble splitEnsemble(Settings & settings, MPI_Comm world, int groupSize = 0)
+{
+    int worldRank, worldSize;
+    MPI_Comm_rank(world, &worldRank);
+    MPI_Comm_size(world, &worldSize);
+
+    if (groupSize <= 0) groupSize = settings.getEnsembleGroupSize() > 0 ? settings.getEnsembleGroupSize() : worldSize;
+    int replicas = settings.getEnsembleReplicas() > 0 ? settings.getEnsembleReplicas() : 1;
+
+    if (worldSize % groupSize != 0)
+        throw std::invalid_argument("ERROR: The number of processes must be a multiple of ensembleGroupSize");
+
+    Ensemble ensemble;
+    ensemble.group = worldRank / groupSize;
+    ensemble.groups = worldSize / groupSize;
+    ensemble.point = ensemble.group / replicas;
+    ensemble.points = (ensemble.groups + replicas - 1) / replicas;
+
+    MPI_Comm_split(world, ensemble.group, worldRank, &ensemble.comm);
+
+    int groupRank;
+    MPI_Comm_rank(ensemble.comm, &groupRank);
+
+    MPI_Comm_split(world, groupRank == 0 ? ensemble.point : MPI_UNDEFINED, worldRank, &ensemble.pointComm);
+
+    ensemble.sweepValue = 0;
+
+    if (!settings.getEnsembleSweepField().empty())
+    {
+        int * field = settings.integerField(settings.getEnsembleSweepField());
+        *field += ensemble.point * settings.getEnsembleSweepStep();
+        ensemble.sweepValue = *field;
+    }
+
+    return ensemble;
+}
+
+inline void freeEnsemble(Ensemble & ensemble)
+{
+    if (ensemble.pointComm != MPI_COMM_NULL) MPI_Comm_free(&ensemble.pointComm);
+    MPI_Comm_free(&ensemble.comm);
+}
+
+class EnsembleStatistics
+{
+    private:
+
+        int generations;
+
+        // replicas advanced together by this rank
+        int localReplicas;
+
+        // ensembleStates counts for every generation of every local replica, local to this rank
+        std::vector<long> counts;
+
+    public:
+
+        EnsembleStatistics(int generations, int localReplicas = 1) : generations(generations), localReplicas(localReplicas),
+            counts((size_t) localReplicas * (generations + 1) * ensembleStates, 0) {}
+
+        // adds one person of this rank to the counts of generation
+        void count(int generation, const Person & person, int replica = 0)
+        {
+            long * states = &counts[((size_t) replica * (generations + 1) + generation) * ensembleStates];
+
+            states[0] += person.values.isInfected;
+            states[1] += person.values.isImmune;
+            states[2] += person.values.isDead;
+            states[3] += person.values.isVaccinated;
+        }
+
+        // collective over the whole world, point roots write their curves
+        void write(const Ensemble & ensemble, const std::string & prefix) const;
+
+};
+
+inline void EnsembleStatistics::write(const Ensemble & ensemble, const std::string & prefix) const
+{
+    std::vector<long> replica(counts.size());
+    MPI_Reduce(counts.data(), replica.data(), counts.size(), MPI_LONG, MPI_SUM, 0, ensemble.comm);
+
+    if (ensemble.pointComm == MPI_COMM_NULL) return;
+
+    // sum and sum of squares over the replicas of this point
+    size_t curve = (size_t) (generations + 1) * ensembleStates;
+
+    std::vector<double> moments(curve * 2, 0);
+    for (size_t c = 0; c < replica.size(); ++c)
+    {
+        moments[c % curve] += replica[c];
+        moments[curve + c % curve] += (double) replica[c] * replica[c];
+    }
+
+    int pointRank, replicas;
+    MPI_Comm_rank(ensemble.pointComm, &pointRank);
+    MPI_Comm_size(ensemble.pointComm, &replicas);
+    replicas *= localReplicas;
+
+    std::vector<double> sums(moments.size());
+    MPI_Reduce(moments.data(), sums.data(), moments.size(), MPI_DOUBLE, MPI_SUM, 0, ensemble.pointComm);
+
+    if (pointRank != 0) return;
+
+    std::string path = prefix + "-point" + std::to_string(ensemble.point) + ".csv";
+    FILE * file = fopen(path.c_str(), "w");
+
+    if (!file) throw std::runtime_error("ERROR: Couldn't create " + path);
+
+    fprintf(file, "# sweep value %d, %d replicas\n", ensemble.sweepValue, replicas);
+    fprintf(file, "generation,infectedMean,infectedVariance,immuneMean,immuneVariance,"
+                  "deadMean,deadVariance,vaccinatedMean,vaccinatedVariance\n");
+
+    for (int g = 0; g <= generations; ++g)
+    {
+        fprintf(file, "%d", g);
+
+        for (int s = 0; s < ensembleStates; ++s)
+        {
+            size_t c = (size_t) g * ensembleStates + s;
+
+            double mean = sums[c] / replicas;
+            double variance = replicas > 1 ? (sums[curve + c] - replicas * mean * mean) / (replicas - 1) : 0;
+
+            fprintf(file, ",%f,%f", mean, variance);
+        }
+
+        fprintf(file, "\n");
+    }
+
+    fclose(file);
+}
+
+#endif
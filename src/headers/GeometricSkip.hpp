@@ -0,0 +1,77 @@
+#ifndef GEOMETRIC_SKIP_HPP
+#define GEOMETRIC_SKIP_HPP
+
+#include <climits> // LONG_MAX
+#include <cmath> // log, floor
+
+#include "Rules.hpp"
+
+// Geometric skip-ahead --------------------------------------------------------------------------------
+//
+// Spontaneous vaccination hits a person with probability vaccinationPercentage / 100000 a day, so
+// rolling for every person spends almost every random number on a miss. The number of misses before
+// the next hit of independent trials with probability p follows a geometric distribution, so it can
+// be drawn at once as floor(log(u) / log(1 - p)) with u uniform in (0, 1], and the trials in between
+// just counted down: random numbers are only drawn for the hits.
+//
+// A GeometricSkip is called where the roll used to be and answers whether that trial is a hit. It
+// draws from rand() unless given another random source, see CounterRng.hpp.
+// -----------------------------------------------------------------------------------------------------
+
+class GeometricSkip
+{
+    private:
+
+        // log(1 - p), 0 when nothing can ever hit
+        double logMiss;
+        bool never;
+
+        // trials left before the next hit, drawn on the first call
+        long remaining;
+
+    public:
+
+        GeometricSkip(double probability = 0) : logMiss(0), never(probability <= 0), remaining(-1)
+        {
+            if (!never && probability < 1) logMiss = log(1 - probability);
+        }
+
+        // misses before the next hit
+        template <typename Random>
+        inline long gap(Random & random) const
+        {
+            if (never) return LONG_MAX;
+            if (logMiss == 0) return 0;
+
+            double u = (random() + 1.0) / 2147483648.0;
+            double misses = floor(log(u) / logMiss);
+
+            return misses < (double) (LONG_MAX / 2) ? (long) misses : LONG_MAX / 2;
+        }
+
+        // whether the next trial is a hit
+        template <typename Random>
+        inline bool next(Random & random)
+        {
+            if (remaining < 0) remaining = gap(random);
+
+            if (remaining-- > 0) return false;
+
+            remaining = gap(random);
+            return true;
+        }
+
+        inline bool operator()()
+        {
+            StandardRandom random;
+            return next(random);
+        }
+
+};
+
+inline GeometricSkip spontaneousVaccinations(const Rules & rules)
+{
+    return GeometricSkip(rules.vaccinationPercentage / 100000.0);
+}
+
+#endif
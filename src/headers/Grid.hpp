@@ -0,0 +1,155 @@
+#ifndef GRID_HPP
+#define GRID_HPP
+
+#include <cstddef> // size_t
+
+#include <mpich/mpi.h>
+#include "ColumnSums.hpp"
+
+// Grid layouts ----------------------------------------------------------------------------------------
+//
+// RowMajor and ColumnMajor say how a rows * cols grid is laid out in memory. Grid<Layout> carries the
+// extents of one grid and derives everything that depends on the order from the layout: the index of
+// a person, the MPI types of a run of a row or of a column, the subarray type of a block, and the
+// traversal order, so the inner loop of forEach() and sweep() always walks contiguous people.
+// A build picks its layout once, at compile time.
+// -----------------------------------------------------------------------------------------------------
+
+struct RowMajor
+{
+    static const int mpiOrder = MPI_ORDER_C;
+
+    static inline size_t index(int i, int j, int /*rows*/, int cols) {return (size_t) i * cols + j;}
+
+    // distance between two people next to each other in a row and in a column
+    static inline int rowStep(int /*rows*/, int /*cols*/) {return 1;}
+    static inline int columnStep(int /*rows*/, int cols) {return cols;}
+
+    template <typename Visit>
+    static inline void forEach(int firstRow, int lastRow, int firstCol, int lastCol, Visit visit)
+    {
+        for (int i = firstRow; i < lastRow; ++i)
+            for (int j = firstCol; j < lastCol; ++j)
+                visit(i, j);
+    }
+
+    // column sums with rows as lines
+    template <typename At, typename Update>
+    static inline void sweep(int firstRow, int lastRow, int firstCol, int lastCol, At at, Update update)
+    {
+        columnSumSweep(firstRow, lastRow, firstCol, lastCol, at, update);
+    }
+};
+
+struct ColumnMajor
+{
+    static const int mpiOrder = MPI_ORDER_FORTRAN;
+
+    static inline size_t index(int i, int j, int rows, int /*cols*/) {return (size_t) j * rows + i;}
+
+    static inline int rowStep(int rows, int /*cols*/) {return rows;}
+    static inline int columnStep(int /*rows*/, int /*cols*/) {return 1;}
+
+    template <typename Visit>
+    static inline void forEach(int firstRow, int lastRow, int firstCol, int lastCol, Visit visit)
+    {
+        for (int j = firstCol; j < lastCol; ++j)
+            for (int i = firstRow; i < lastRow; ++i)
+                visit(i, j);
+    }
+
+    // column sums with columns as lines
+    template <typename At, typename Update>
+    static inline void sweep(int firstRow, int lastRow, int firstCol, int lastCol, At at, Update update)
+    {
+        columnSumSweep(firstCol, lastCol, firstRow, lastRow,
+            [&at](int j, int i) -> decltype(at(i, j)) {return at(i, j);},
+            [&update](int j, int i, short infectedNeighbours, short vaccinatedNeighbours)
+            {
+                update(i, j, infectedNeighbours, vaccinatedNeighbours);
+            });
+    }
+};
+
+// people of the whole grid owned by a rank or a tile
+struct Block
+{
+    int firstRow;
+    int firstCol;
+    int rows;
+    int cols;
+};
+
+template <typename Layout>
+class Grid
+{
+    private:
+
+        int rows;
+        int cols;
+
+    public:
+
+        Grid(int rows = 0, int cols = 0) : rows(rows), cols(cols) {}
+
+        inline int getRows() const {return this->rows;}
+        inline int getCols() const {return this->cols;}
+        inline size_t size() const {return (size_t) rows * cols;}
+
+        inline size_t index(int i, int j) const {return Layout::index(i, j, rows, cols);}
+
+        // count people of a row starting anywhere in it
+        void rowType(int count, MPI_Datatype element, MPI_Datatype * type) const
+        {
+            MPI_Type_vector(count, 1, Layout::rowStep(rows, cols), element, type);
+            MPI_Type_commit(type);
+        }
+
+        // count people of a column starting anywhere in it
+        void columnType(int count, MPI_Datatype element, MPI_Datatype * type) const
+        {
+            MPI_Type_vector(count, 1, Layout::columnStep(rows, cols), element, type);
+            MPI_Type_commit(type);
+        }
+
+        // blockRows * blockCols people starting at (firstRow, firstCol), used from the start of the grid
+        void blockType(int firstRow, int firstCol, int blockRows, int blockCols, MPI_Datatype element, MPI_Datatype * type) const
+        {
+            int sizes[2] = {rows, cols};
+            int subsizes[2] = {blockRows, blockCols};
+            int starts[2] = {firstRow, firstCol};
+
+            MPI_Type_create_subarray(2, sizes, subsizes, starts, Layout::mpiOrder, element, type);
+            MPI_Type_commit(type);
+        }
+
+        template <typename Visit>
+        inline void forEach(int firstRow, int lastRow, int firstCol, int lastCol, Visit visit) const
+        {
+            Layout::forEach(firstRow, lastRow, firstCol, lastCol, visit);
+        }
+
+        // column sums over rows [firstRow, lastRow) and columns [firstCol, lastCol), see ColumnSums.hpp
+        template <typename At, typename Update>
+        inline void sweep(int firstRow, int lastRow, int firstCol, int lastCol, At at, Update update) const
+        {
+            Layout::sweep(firstRow, lastRow, firstCol, lastCol, at, update);
+        }
+
+};
+
+// MPI type of a whole Person
+inline MPI_Datatype personType()
+{
+    static MPI_Datatype type = MPI_DATATYPE_NULL;
+
+    if (type == MPI_DATATYPE_NULL)
+    {
+        MPI_Type_contiguous(sizeof(Person), MPI_BYTE, &type);
+        MPI_Type_commit(&type);
+    }
+
+    return type;
+}
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef HILBERT_HPP
+#define HILBERT_HPP
+
+#include <cstddef> // size_t
+#include <vector> // vector
+
+// Hilbert tile order ----------------------------------------------------------------------------------
+//
+// The tiles build cuts the grid in many more tiles than ranks and hands every rank a run of consecutive
+// tiles along a Hilbert curve. Tiles next to each other on the curve are next to each other on the
+// grid, so a run is a compact region with few tiles on its border whatever its length, and moving the
+// ends of the runs is enough to balance the load as the outbreak spreads.
+// -----------------------------------------------------------------------------------------------------
+
+// position (x, y) of the d-th cell of the Hilbert curve filling an n * n square, n a power of two
+inline void hilbertCell(int n, long d, int & x, int & y)
+{
+    x = y = 0;
+
+    for (int s = 1; s < n; s *= 2)
+    {
+        int rx = 1 & (d / 2);
+        int ry = 1 & (d ^ rx);
+
+        // rotate the quadrant
+        if (ry == 0)
+        {
+            if (rx == 1)
+            {
+                x = s - 1 - x;
+                y = s - 1 - y;
+            }
+
+            int t = x;
+            x = y;
+            y = t;
+        }
+
+        x += s * rx;
+        y += s * ry;
+        d /= 4;
+    }
+}
+
+// tiles of a tileRows * tileCols grid of tiles, tile (i, j) is i * tileCols + j, in the order of the
+// curve over the smallest power of two square that holds them
+inline std::vector<int> hilbertOrder(int tileRows, int tileCols)
+{
+    int n = 1;
+    while (n < tileRows || n < tileCols) n *= 2;
+
+    std::vector<int> order;
+    order.reserve((size_t) tileRows * tileCols);
+
+    for (long d = 0; d < (long) n * n; ++d)
+    {
+        int i, j;
+        hilbertCell(n, d, j, i);
+
+        if (i < tileRows && j < tileCols) order.push_back(i * tileCols + j);
+    }
+
+    return order;
+}
+
+// Owner of every tile when the curve is cut in parts runs of about the same cost, every part gets
+// at least one tile. costs is indexed by tile.
+inline std::vector<int> curveOwners(const std::vector<int> & order, const std::vector<double> & costs, int parts)
+{
+    int tiles = order.size();
+    double total = 0;
+
+    for (int tile : order) total += costs[tile];
+
+    std::vector<int> owners(tiles);
+    double done = 0;
+    int part = 0;
+
+    for (int k = 0; k < tiles; ++k)
+    {
+        // move on once this part has its share, but leave a tile for each of the parts after it
+        bool full = done + costs[order[k]] / 2 > total * (part + 1) / parts;
+        bool needed = tiles - k <= parts - 1 - part;
+
+        if (part < parts - 1 && k > 0 && owners[order[k - 1]] == part && (full || needed)) ++part;
+
+        owners[order[k]] = part;
+        done += costs[order[k]];
+    }
+
+    return owners;
+}
+
+#endif
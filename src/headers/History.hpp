@@ -0,0 +1,498 @@
+#ifndef HISTORY_HPP
+#define HISTORY_HPP
+
+#include <cstdio> // FILE, fopen, fwrite
+#include <cstring> // memcmp
+#include <cstdint> // uint16_t, uint32_t, uint64_t
+#include <algorithm> // min
+#include <string> // string
+#include <vector> // vector
+#include <deque> // deque
+#include <thread> // thread
+#include <mutex> // mutex
+#include <condition_variable> // condition_variable
+#include <stdexcept> // runtime_error
+
+#include "Person.hpp"
+
+// Generation history ----------------------------------------------------------------------------------
+//
+// A history log keeps every generation of a run in little space:
+//
+//      header   -> "CVHS" | version | rows | cols | tile size | keyframe interval
+//      ages     -> rows * cols bytes, age never changes so it's stored once
+//      records  -> tag | generation | payload size | payload
+//      index    -> (generation, offset) of every keyframe, followed by its offset and "CVHI"
+//
+// A keyframe record holds Person::all of every cell. A delta record holds, for each 64x64 tile that
+// changed, the tile number, the number of changes and the sorted (index inside tile, new Person::all)
+// pairs. Every keyframeInterval generations a keyframe is written instead of a delta so a reader can
+// seek close to any generation and replay only a few deltas.
+//
+// Encoding and writing happen on a background thread: record() only copies Person::all of the current
+// grid into a recycled buffer, so the simulation is never stalled by the disk unless it gets more than
+// historyQueueLength generations ahead.
+// -----------------------------------------------------------------------------------------------------
+
+#define historyMagic "CVHS"
+#define historyIndexMagic "CVHI"
+#define historyVersion 1
+#define historyTileSize 64
+#define historyQueueLength 4
+
+#define historyKeyframe 'K'
+#define historyDelta 'D'
+
+struct HistoryHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t rows;
+    uint32_t cols;
+    uint32_t tileSize;
+    uint32_t keyframeInterval;
+};
+
+struct HistoryRecord
+{
+    uint8_t tag;
+    uint32_t generation;
+    uint64_t size;
+};
+
+inline void writeHistoryRecord(FILE * file, const HistoryRecord & record)
+{
+    fwrite(&record.tag, sizeof(record.tag), 1, file);
+    fwrite(&record.generation, sizeof(record.generation), 1, file);
+    fwrite(&record.size, sizeof(record.size), 1, file);
+}
+
+inline bool readHistoryRecord(FILE * file, HistoryRecord & record)
+{
+    return fread(&record.tag, sizeof(record.tag), 1, file) == 1 &&
+           fread(&record.generation, sizeof(record.generation), 1, file) == 1 &&
+           fread(&record.size, sizeof(record.size), 1, file) == 1;
+}
+
+// Writer ----------------------------------------------------------------------------------------------
+
+class HistoryWriter
+{
+    private:
+
+        struct Frame
+        {
+            uint32_t generation;
+            std::vector<uint16_t> cells;
+        };
+
+        FILE * file;
+
+        int rows;
+
+        int cols;
+
+        int keyframeInterval;
+
+        int stride;
+
+        std::vector<uint16_t> previous;
+
+        std::vector<uint8_t> encoded;
+
+        std::vector<std::pair<uint32_t, uint64_t>> keyframes;
+
+        std::deque<Frame> pending;
+
+        std::vector<std::vector<uint16_t>> recycled;
+
+        std::mutex mutex;
+
+        std::condition_variable changed;
+
+        bool closing = false;
+
+        std::thread worker;
+
+        void run();
+
+        void writeFrame(const Frame & frame);
+
+        void encodeDelta(const std::vector<uint16_t> & cells);
+
+    public:
+
+        // generation 0 is recorded from initial as a keyframe, stride is the distance between rows of the
+        // grids handed to the writer (cols when 0)
+        HistoryWriter(const std::string & path, int rows, int cols, int keyframeInterval, const Person * initial, int stride = 0);
+
+        ~HistoryWriter();
+
+        HistoryWriter(const HistoryWriter &) = delete;
+        HistoryWriter & operator=(const HistoryWriter &) = delete;
+
+        // current is a row-major rows * cols grid with rows stride apart
+        void record(int generation, const Person * current);
+
+};
+
+inline HistoryWriter::HistoryWriter(const std::string & path, int rows, int cols, int keyframeInterval, const Person * initial, int stride)
+    : rows(rows), cols(cols), keyframeInterval(keyframeInterval > 0 ? keyframeInterval : 1), stride(stride > 0 ? stride : cols)
+{
+    file = fopen(path.c_str(), "wb");
+    if (!file) throw std::runtime_error("ERROR: Couldn't create history file " + path);
+
+    HistoryHeader header = {{'C', 'V', 'H', 'S'}, historyVersion, (uint32_t) rows, (uint32_t) cols,
+                            historyTileSize, (uint32_t) this->keyframeInterval};
+    fwrite(&header, sizeof(header), 1, file);
+
+    std::vector<uint8_t> ages((size_t) rows * cols);
+    for (int i = 0; i < rows; ++i)
+        for (int j = 0; j < cols; ++j)
+            ages[(size_t) i * cols + j] = initial[(size_t) i * this->stride + j].values.age;
+    fwrite(ages.data(), 1, ages.size(), file);
+
+    Frame frame;
+    frame.generation = 0;
+    frame.cells.resize((size_t) rows * cols);
+    for (int i = 0; i < rows; ++i)
+        for (int j = 0; j < cols; ++j)
+            frame.cells[(size_t) i * cols + j] = initial[(size_t) i * this->stride + j].all;
+
+    writeFrame(frame);
+    previous.swap(frame.cells);
+
+    worker = std::thread(&HistoryWriter::run, this);
+}
+
+inline HistoryWriter::~HistoryWriter()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closing = true;
+    }
+    changed.notify_all();
+    worker.join();
+
+    // keyframe index, found by readers through the trailing offset
+    uint64_t indexOffset = ftell(file);
+    uint32_t count = keyframes.size();
+
+    fwrite(&count, sizeof(count), 1, file);
+    for (auto & keyframe : keyframes)
+    {
+        fwrite(&keyframe.first, sizeof(keyframe.first), 1, file);
+        fwrite(&keyframe.second, sizeof(keyframe.second), 1, file);
+    }
+    fwrite(&indexOffset, sizeof(indexOffset), 1, file);
+    fwrite(historyIndexMagic, 1, 4, file);
+
+    fclose(file);
+}
+
+inline void HistoryWriter::record(int generation, const Person * current)
+{
+    Frame frame;
+    frame.generation = generation;
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [this] {return pending.size() < historyQueueLength;});
+
+        if (!recycled.empty())
+        {
+            frame.cells.swap(recycled.back());
+            recycled.pop_back();
+        }
+    }
+
+    frame.cells.resize((size_t) rows * cols);
+    for (int i = 0; i < rows; ++i)
+        for (int j = 0; j < cols; ++j)
+            frame.cells[(size_t) i * cols + j] = current[(size_t) i * stride + j].all;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.push_back(std::move(frame));
+    }
+    changed.notify_all();
+}
+
+inline void HistoryWriter::run()
+{
+    while (true)
+    {
+        Frame frame;
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock, [this] {return closing || !pending.empty();});
+
+            if (pending.empty()) return;
+
+            frame = std::move(pending.front());
+            pending.pop_front();
+        }
+        changed.notify_all();
+
+        writeFrame(frame);
+
+        // the frame becomes the reference of the next delta, the old reference is handed back to record()
+        previous.swap(frame.cells);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        recycled.push_back(std::move(frame.cells));
+    }
+}
+
+inline void HistoryWriter::writeFrame(const Frame & frame)
+{
+    HistoryRecord record;
+    record.generation = frame.generation;
+
+    if (frame.generation % keyframeInterval == 0)
+    {
+        keyframes.push_back({frame.generation, (uint64_t) ftell(file)});
+
+        record.tag = historyKeyframe;
+        record.size = frame.cells.size() * sizeof(uint16_t);
+
+        writeHistoryRecord(file, record);
+        fwrite(frame.cells.data(), sizeof(uint16_t), frame.cells.size(), file);
+        return;
+    }
+
+    encodeDelta(frame.cells);
+
+    record.tag = historyDelta;
+    record.size = encoded.size();
+
+    writeHistoryRecord(file, record);
+    fwrite(encoded.data(), 1, encoded.size(), file);
+}
+
+inline void HistoryWriter::encodeDelta(const std::vector<uint16_t> & cells)
+{
+    encoded.clear();
+
+    auto put = [this](const void * value, size_t size)
+    {
+        const uint8_t * bytes = (const uint8_t *) value;
+        encoded.insert(encoded.end(), bytes, bytes + size);
+    };
+
+    int tileCols = (cols + historyTileSize - 1) / historyTileSize;
+
+    for (int ti = 0; ti < rows; ti += historyTileSize)
+    {
+        for (int tj = 0; tj < cols; tj += historyTileSize)
+        {
+            size_t countAt = 0;
+            uint32_t count = 0;
+
+            for (int i = ti; i < std::min(rows, ti + historyTileSize); ++i)
+            {
+                for (int j = tj; j < std::min(cols, tj + historyTileSize); ++j)
+                {
+                    size_t c = (size_t) i * cols + j;
+                    if (cells[c] == previous[c]) continue;
+
+                    // tile header is only written for tiles that changed
+                    if (count == 0)
+                    {
+                        uint32_t tile = (ti / historyTileSize) * tileCols + tj / historyTileSize;
+                        put(&tile, sizeof(tile));
+                        countAt = encoded.size();
+                        put(&count, sizeof(count));
+                    }
+
+                    uint16_t index = (i - ti) * historyTileSize + (j - tj);
+                    put(&index, sizeof(index));
+                    put(&cells[c], sizeof(cells[c]));
+                    ++count;
+                }
+            }
+
+            if (count) memcpy(&encoded[countAt], &count, sizeof(count));
+        }
+    }
+}
+
+// Reader ----------------------------------------------------------------------------------------------
+
+class HistoryReader
+{
+    private:
+
+        FILE * file;
+
+        HistoryHeader header;
+
+        std::vector<uint8_t> ages;
+
+        std::vector<std::pair<uint32_t, uint64_t>> keyframes;
+
+        void scanKeyframes();
+
+        // false if the payload runs past its end or out of the grid
+        bool applyDelta(const std::vector<uint8_t> & payload, std::vector<uint16_t> & cells) const;
+
+    public:
+
+        HistoryReader(const std::string & path);
+
+        ~HistoryReader() {fclose(file);}
+
+        HistoryReader(const HistoryReader &) = delete;
+        HistoryReader & operator=(const HistoryReader &) = delete;
+
+        int getRows() const {return this->header.rows;}
+
+        int getCols() const {return this->header.cols;}
+
+        // rebuilds generation into a row-major rows * cols grid, false if the log doesn't hold it (tiled
+        // runs only record every generationsPerTile-th one) or is damaged on the way
+        bool seek(uint32_t generation, Person * grid);
+
+};
+
+inline HistoryReader::HistoryReader(const std::string & path)
+{
+    file = fopen(path.c_str(), "rb");
+    if (!file) throw std::runtime_error("ERROR: Couldn't open/find history file " + path);
+
+    if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, historyMagic, 4) != 0 ||
+        header.version != historyVersion)
+    {
+        fclose(file);
+        throw std::runtime_error("ERROR: " + path + " is not a history file");
+    }
+
+    ages.resize((size_t) header.rows * header.cols);
+    if (fread(ages.data(), 1, ages.size(), file) != ages.size())
+    {
+        fclose(file);
+        throw std::runtime_error("ERROR: History file " + path + " is truncated");
+    }
+
+    // the index is missing when the run didn't terminate, fall back to walking the records
+    char magic[4];
+    uint64_t indexOffset;
+    uint32_t count;
+
+    fseek(file, -(long) (sizeof(indexOffset) + sizeof(magic)), SEEK_END);
+
+    if (fread(&indexOffset, sizeof(indexOffset), 1, file) == 1 && fread(magic, 1, 4, file) == 4 &&
+        memcmp(magic, historyIndexMagic, 4) == 0 && fseek(file, indexOffset, SEEK_SET) == 0 &&
+        fread(&count, sizeof(count), 1, file) == 1)
+    {
+        keyframes.resize(count);
+        for (auto & keyframe : keyframes)
+        {
+            if (fread(&keyframe.first, sizeof(keyframe.first), 1, file) != 1 ||
+                fread(&keyframe.second, sizeof(keyframe.second), 1, file) != 1)
+            {
+                // a damaged index is as good as a missing one
+                keyframes.clear();
+                scanKeyframes();
+                return;
+            }
+        }
+    }
+    else scanKeyframes();
+}
+
+inline void HistoryReader::scanKeyframes()
+{
+    fseek(file, sizeof(header) + ages.size(), SEEK_SET);
+
+    HistoryRecord record;
+    uint64_t offset = ftell(file);
+
+    while (readHistoryRecord(file, record) && (record.tag == historyKeyframe || record.tag == historyDelta))
+    {
+        if (record.tag == historyKeyframe) keyframes.push_back({record.generation, offset});
+
+        if (fseek(file, record.size, SEEK_CUR) != 0) break;
+        offset = ftell(file);
+    }
+}
+
+inline bool HistoryReader::seek(uint32_t generation, Person * grid)
+{
+    // latest keyframe not after generation
+    int start = -1;
+    for (size_t k = 0; k < keyframes.size() && keyframes[k].first <= generation; ++k) start = k;
+
+    if (start < 0) return false;
+
+    std::vector<uint16_t> cells(ages.size());
+    std::vector<uint8_t> payload;
+
+    HistoryRecord record;
+    fseek(file, keyframes[start].second, SEEK_SET);
+    if (!readHistoryRecord(file, record) || record.tag != historyKeyframe) return false;
+    if (fread(cells.data(), sizeof(uint16_t), cells.size(), file) != cells.size()) return false;
+
+    while (record.generation < generation)
+    {
+        if (!readHistoryRecord(file, record)) return false;
+
+        payload.resize(record.size);
+        if (fread(payload.data(), 1, payload.size(), file) != payload.size()) return false;
+
+        if (record.tag == historyKeyframe && payload.size() == cells.size() * sizeof(uint16_t))
+            memcpy(cells.data(), payload.data(), payload.size());
+        else if (record.tag != historyDelta || !applyDelta(payload, cells)) return false;
+    }
+
+    if (record.generation != generation) return false;
+
+    for (size_t c = 0; c < cells.size(); ++c)
+    {
+        grid[c].all = cells[c];
+        grid[c].values.age = ages[c];
+    }
+
+    return true;
+}
+
+inline bool HistoryReader::applyDelta(const std::vector<uint8_t> & payload, std::vector<uint16_t> & cells) const
+{
+    size_t tileRows = (header.rows + historyTileSize - 1) / historyTileSize;
+    size_t tileCols = (header.cols + historyTileSize - 1) / historyTileSize;
+    size_t at = 0;
+
+    while (at < payload.size())
+    {
+        uint32_t tile, count;
+
+        if (payload.size() - at < sizeof(tile) + sizeof(count)) return false;
+        memcpy(&tile, &payload[at], sizeof(tile)); at += sizeof(tile);
+        memcpy(&count, &payload[at], sizeof(count)); at += sizeof(count);
+
+        if (tile >= tileRows * tileCols || (payload.size() - at) / (2 * sizeof(uint16_t)) < count) return false;
+
+        size_t ti = (tile / tileCols) * historyTileSize;
+        size_t tj = (tile % tileCols) * historyTileSize;
+
+        for (uint32_t n = 0; n < count; ++n)
+        {
+            uint16_t index, value;
+            memcpy(&index, &payload[at], sizeof(index)); at += sizeof(index);
+            memcpy(&value, &payload[at], sizeof(value)); at += sizeof(value);
+
+            // edge tiles are cut by the grid
+            size_t i = ti + index / historyTileSize;
+            size_t j = tj + index % historyTileSize;
+
+            if (index >= historyTileSize * historyTileSize || i >= header.rows || j >= header.cols) return false;
+
+            cells[i * header.cols + j] = value;
+        }
+    }
+
+    return true;
+}
+
+#endif
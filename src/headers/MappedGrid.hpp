@@ -0,0 +1,113 @@
+#ifndef MAPPED_GRID_HPP
+#define MAPPED_GRID_HPP
+
+#include <cstdlib> // mkstemp
+#include <string> // string
+#include <stdexcept> // runtime_error
+
+#include <fcntl.h> // open
+#include <sys/mman.h> // mmap, madvise
+#include <unistd.h> // ftruncate, unlink, sysconf
+
+#include "Person.hpp"
+
+// File-backed grid ------------------------------------------------------------------------------------
+//
+// Keeps a whole rows * cols grid of Person in a MAP_SHARED file mapping so the sequential build can
+// simulate grids larger than RAM: the kernel pages cells in and out of the page cache on its own.
+// The grid is meant to be swept in row bands, adviseBand() tells the kernel which band comes next and
+// which one can be dropped, so the mapping is streamed instead of thrashing.
+// The backing file is unlinked right after creation, nothing is left behind when the process exits.
+// -----------------------------------------------------------------------------------------------------
+
+class MappedGrid
+{
+    private:
+
+        int fd;
+
+        size_t length;
+
+        Person * cells;
+
+        size_t cols;
+
+        size_t pageSize;
+
+        void advise(size_t firstRow, size_t lastRow, int advice) const;
+
+    public:
+
+        MappedGrid(const std::string & directory, int rows, int cols);
+
+        ~MappedGrid();
+
+        MappedGrid(const MappedGrid &) = delete;
+        MappedGrid & operator=(const MappedGrid &) = delete;
+
+        Person * data() const {return this->cells;}
+
+        // prefetch [firstRow, lastRow) for a sequential sweep and release [releaseFirst, releaseLast)
+        void adviseBand(int firstRow, int lastRow, int releaseFirst, int releaseLast) const;
+
+};
+
+inline MappedGrid::MappedGrid(const std::string & directory, int rows, int cols) : cols(cols)
+{
+    std::string path = directory + "/covid19-grid-XXXXXX";
+
+    fd = mkstemp(&path[0]);
+    if (fd < 0) throw std::runtime_error("ERROR: Couldn't create grid file in " + directory);
+
+    unlink(path.c_str());
+
+    length = (size_t) rows * cols * sizeof(Person);
+    pageSize = sysconf(_SC_PAGESIZE);
+
+    if (ftruncate(fd, length) != 0)
+    {
+        close(fd);
+        throw std::runtime_error("ERROR: Couldn't grow grid file in " + directory);
+    }
+
+    void * address = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (address == MAP_FAILED)
+    {
+        close(fd);
+        throw std::runtime_error("ERROR: Couldn't map grid file in " + directory);
+    }
+
+    cells = (Person *) address;
+
+    madvise(cells, length, MADV_SEQUENTIAL);
+}
+
+inline MappedGrid::~MappedGrid()
+{
+    munmap(cells, length);
+    close(fd);
+}
+
+inline void MappedGrid::advise(size_t firstRow, size_t lastRow, int advice) const
+{
+    if (lastRow <= firstRow) return;
+
+    // madvise wants a page aligned start
+    size_t begin = firstRow * cols * sizeof(Person);
+    size_t end = lastRow * cols * sizeof(Person);
+
+    begin -= begin % pageSize;
+    if (end > length) end = length;
+
+    madvise((char *) cells + begin, end - begin, advice);
+}
+
+inline void MappedGrid::adviseBand(int firstRow, int lastRow, int releaseFirst, int releaseLast) const
+{
+    advise(firstRow, lastRow, MADV_WILLNEED);
+
+    // dirty pages of a shared mapping stay in the page cache, dropping them only unmaps them
+    advise(releaseFirst, releaseLast, MADV_DONTNEED);
+}
+
+#endif
@@ -0,0 +1,158 @@
+#ifndef OUTBREAK_HPP
+#define OUTBREAK_HPP
+
+#include <cstdio> // fprintf
+#include <fstream> // ifstream
+#include <string> // string
+#include <vector> // vector
+#include <stdexcept> // runtime_error
+
+#include <mpich/mpi.h>
+#include "Settings.hpp"
+#include "CounterRng.hpp"
+
+// Initial outbreak ------------------------------------------------------------------------------------
+//
+// The people infected before the first generation, placed by the outbreak setting:
+//
+//      centre    -> a single person in the middle of the grid
+//      random    -> outbreakSeeds people anywhere on the grid
+//      clustered -> outbreakSeeds people shared between outbreakClusters clusters, every one of them
+//                   at most outbreakRadius rows and columns away from the centre of its cluster
+//      file      -> the people listed in outbreakFile, one "row col" pair per line
+//
+// Placements are drawn from the seed setting, so every replica and every rank count starts from the
+// same outbreak. Only a root builds the list: the parallel builds hand every rank the seeds of its
+// own part with one MPI_Scatterv, nobody gets the seeds of the others.
+// -----------------------------------------------------------------------------------------------------
+
+struct OutbreakSeed
+{
+    int row;
+    int col;
+};
+
+// the population draws with the generation before the first one, the outbreak with the one before that
+#define outbreakGeneration -2
+
+inline std::vector<OutbreakSeed> readOutbreakFile(const std::string & path, int rows, int cols)
+{
+    std::ifstream file(path);
+
+    if (!file)
+        throw std::runtime_error("ERROR: Couldn't open/find outbreak file " + path);
+
+    std::vector<OutbreakSeed> seeds;
+    OutbreakSeed seed;
+
+    while (file >> seed.row >> seed.col)
+    {
+        if (seed.row < 0 || seed.row >= rows || seed.col < 0 || seed.col >= cols)
+            throw std::runtime_error("ERROR: Outbreak file " + path + " has a person outside the grid");
+
+        seeds.push_back(seed);
+    }
+
+    if (!file.eof())
+        throw std::runtime_error("ERROR: Outbreak file " + path + " must hold row col pairs");
+
+    return seeds;
+}
+
+// every person infected at the start, in no particular order and maybe more than once
+inline std::vector<OutbreakSeed> outbreakSeeds(const Settings & settings, int rows, int cols)
+{
+    std::string placement = settings.getOutbreak();
+
+    if (placement == "centre") return {{rows / 2, cols / 2}};
+
+    if (placement == "file") return readOutbreakFile(settings.getOutbreakFile(), rows, cols);
+
+    CounterRandom random(settings.getSeed(), outbreakGeneration, 0, 0);
+    std::vector<OutbreakSeed> seeds(settings.getOutbreakSeeds());
+
+    if (placement == "random")
+    {
+        for (OutbreakSeed & seed : seeds)
+        {
+            seed.row = random() % rows;
+            seed.col = random() % cols;
+        }
+
+        return seeds;
+    }
+
+    // clustered, the grid wraps around so a cluster near an edge goes on at the other side
+    int clusters = settings.getOutbreakClusters();
+    int radius = settings.getOutbreakRadius();
+
+    std::vector<OutbreakSeed> centres(clusters);
+
+    for (OutbreakSeed & centre : centres)
+    {
+        centre.row = random() % rows;
+        centre.col = random() % cols;
+    }
+
+    for (size_t k = 0; k < seeds.size(); ++k)
+    {
+        const OutbreakSeed & centre = centres[k % clusters];
+
+        seeds[k].row = ((centre.row + random() % (2 * radius + 1) - radius) % rows + rows) % rows;
+        seeds[k].col = ((centre.col + random() % (2 * radius + 1) - radius) % cols + cols) % cols;
+    }
+
+    return seeds;
+}
+
+// The seeds owned by this rank of comm, owner(row, col) gives the rank owning a person and only has
+// to be valid on root.
+template <typename Owner>
+std::vector<OutbreakSeed> scatterOutbreak(const Settings & settings, int rows, int cols, MPI_Comm comm, Owner owner, int root = 0)
+{
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    std::vector<int> counts(size, 0), displacements(size, 0);
+    std::vector<OutbreakSeed> sorted;
+
+    if (rank == root)
+    {
+        // a bad outbreak file would otherwise leave the other ranks waiting in the scatter
+        std::vector<OutbreakSeed> seeds;
+
+        try { seeds = outbreakSeeds(settings, rows, cols); }
+        catch (const std::exception & error)
+        {
+            fprintf(stderr, "%s\n", error.what());
+            MPI_Abort(comm, 1);
+        }
+
+        std::vector<int> owners(seeds.size());
+
+        for (size_t k = 0; k < seeds.size(); ++k)
+        {
+            owners[k] = owner(seeds[k].row, seeds[k].col);
+            ++counts[owners[k]];
+        }
+
+        for (int r = 1; r < size; ++r) displacements[r] = displacements[r - 1] + counts[r - 1];
+
+        // grouped by owner, in the order of the ranks
+        std::vector<int> next = displacements;
+        sorted.resize(seeds.size());
+
+        for (size_t k = 0; k < seeds.size(); ++k) sorted[next[owners[k]]++] = seeds[k];
+    }
+
+    int count;
+    MPI_Scatter(counts.data(), 1, MPI_INT, &count, 1, MPI_INT, root, comm);
+
+    std::vector<OutbreakSeed> seeds(count);
+    MPI_Scatterv(sorted.data(), counts.data(), displacements.data(), MPI_2INT, seeds.data(), count, MPI_2INT, root, comm);
+
+    return seeds;
+}
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef PERSON_HPP
+#define PERSON_HPP
+
+#include <cstdint> // uint8_t
+
+union Person {
+	struct {
+		uint8_t isInfected:1;
+		uint8_t isImmune:1;
+		uint8_t isDead:1;
+		uint8_t isVaccinated:1;
+		uint8_t daysOfIncubation:2;
+		uint8_t daysOfInfection:3;
+		uint8_t age:7;
+	}values;
+
+	unsigned short all;
+};
+
+#endif
@@ -0,0 +1,295 @@
+#ifndef POPULATION_LOADER_HPP
+#define POPULATION_LOADER_HPP
+
+#include <algorithm> // sort, copy
+#include <cstring> // memcmp
+#include <string> // string
+#include <vector> // vector
+#include <stdexcept> // runtime_error
+
+#include <fcntl.h> // open
+#include <sys/mman.h> // mmap, madvise
+#include <sys/stat.h> // fstat
+#include <unistd.h> // close
+
+#include <mpich/mpi.h>
+#include "Person.hpp"
+#include "CounterRng.hpp"
+#include "Grid.hpp"
+
+// Population raster -----------------------------------------------------------------------------------
+//
+// A population map is a binary raster made of a fixed header followed by rows * cols cells stored
+// row-major. Every cell is an unsigned 16-bit value:
+//
+//      low byte  -> age of the person (0..127)
+//      high byte -> initial state flags (see populationInfected, populationImmune, ...)
+//
+// The header fields and the cells are stored in the byte order of the host that wrote the file, they
+// are read natively (the "native" datarep of MPI-IO, a plain mmap in the sequential build), so a file
+// only moves between hosts of the same endianness. The format doesn't depend on the in-memory layout
+// of Person, so the same file seeds every build.
+// -----------------------------------------------------------------------------------------------------
+
+#define populationMagic "CVPM"
+#define populationVersion 1
+
+#define populationInfected 0x01
+#define populationImmune 0x02
+#define populationDead 0x04
+#define populationVaccinated 0x08
+
+struct PopulationHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t rows;
+    uint32_t cols;
+};
+
+inline Person decodePopulationCell(uint16_t cell)
+{
+    Person person;
+    person.all = 0;
+
+    uint8_t flags = cell >> 8;
+
+    person.values.age = (cell & 0xFF) % 128;
+    person.values.isInfected = (flags & populationInfected) != 0;
+    person.values.isImmune = (flags & populationImmune) != 0;
+    person.values.isDead = (flags & populationDead) != 0;
+    person.values.isVaccinated = (flags & populationVaccinated) != 0;
+
+    return person;
+}
+
+inline void checkPopulationHeader(const PopulationHeader & header, int rows, int cols)
+{
+    if (memcmp(header.magic, populationMagic, 4) != 0 || header.version != populationVersion)
+        throw std::runtime_error("ERROR: Population file is not a valid population raster");
+
+    if ((int) header.rows != rows || (int) header.cols != cols)
+        throw std::runtime_error("ERROR: Population raster size doesn't match the grid");
+}
+
+// Generated population --------------------------------------------------------------------------------
+//
+// Without a population file the age of every person is hashed from a seed and its global position
+// (see CounterRng.hpp), everyone starts susceptible. A rank fills its own block without talking to
+// anyone and never needs the rest of the grid, and the same seed gives the same people whatever the
+// number of ranks and however the grid is split between them.
+// -----------------------------------------------------------------------------------------------------
+
+// the kernels draw with generations from 0 on, the population takes the one before
+#define populationGeneration -1
+
+// seed of the people of a replica, so that the replicas of an ensemble don't all start alike
+inline uint64_t populationSeed(int seed, int replica)
+{
+    return counterHash((uint64_t) (uint32_t) seed << 32 | (uint32_t) replica);
+}
+
+inline Person generatedPerson(uint64_t seed, int i, int j)
+{
+    CounterRandom random(seed, populationGeneration, i, j);
+
+    Person person;
+    person.all = 0;
+    person.values.age = random() % 100;
+
+    return person;
+}
+
+// Parallel read ---------------------------------------------------------------------------------------
+//
+// Every rank of comm reads only its own [rowStart, rowStart + blockRows) x [colStart, colStart + blockCols)
+// block with a single collective MPI_File_read_all, so the filesystem sees one header read (root) plus
+// one aggregated read of the body no matter how many ranks there are.
+// block is filled row-major, blockRows * blockCols cells.
+
+// opens the raster on every rank of comm, root reads and checks the header for all of them
+inline MPI_File openPopulationFile(const std::string & path, MPI_Comm comm, int rows, int cols)
+{
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+
+    MPI_File file;
+    if (MPI_File_open(comm, path.c_str(), MPI_MODE_RDONLY, MPI_INFO_NULL, &file) != MPI_SUCCESS)
+        throw std::runtime_error("ERROR: Couldn't open/find population file " + path);
+
+    // only root touches the header, everyone else gets it from the broadcast
+    PopulationHeader header;
+    if (rank == 0) MPI_File_read_at(file, 0, &header, sizeof(header), MPI_BYTE, MPI_STATUS_IGNORE);
+    MPI_Bcast(&header, sizeof(header), MPI_BYTE, 0, comm);
+
+    try { checkPopulationHeader(header, rows, cols); }
+    catch (...)
+    {
+        MPI_File_close(&file);
+        throw;
+    }
+
+    return file;
+}
+
+inline void readPopulationBlock(const std::string & path, MPI_Comm comm, int rows, int cols,
+                                int rowStart, int colStart, int blockRows, int blockCols,
+                                std::vector<uint16_t> & block)
+{
+    MPI_File file = openPopulationFile(path, comm, rows, cols);
+
+    int sizes[2] = {rows, cols};
+    int subSizes[2] = {blockRows, blockCols};
+    int starts[2] = {rowStart, colStart};
+
+    MPI_Datatype blockType;
+    MPI_Type_create_subarray(2, sizes, subSizes, starts, MPI_ORDER_C, MPI_UNSIGNED_SHORT, &blockType);
+    MPI_Type_commit(&blockType);
+
+    block.resize((size_t) blockRows * blockCols);
+
+    MPI_File_set_view(file, sizeof(PopulationHeader), MPI_UNSIGNED_SHORT, blockType, "native", MPI_INFO_NULL);
+    MPI_File_read_all(file, block.data(), blockRows * blockCols, MPI_UNSIGNED_SHORT, MPI_STATUS_IGNORE);
+
+    MPI_Type_free(&blockType);
+    MPI_File_close(&file);
+}
+
+// The same for a rank owning several blocks, all of them still in one MPI_File_read_all: the view is
+// made of the rows of every block in file order, as a file view has to go forward. blocks[b] is
+// filled row-major, rows * cols cells of block b.
+inline void readPopulationBlocks(const std::string & path, MPI_Comm comm, int rows, int cols,
+                                 const std::vector<Block> & owned, std::vector<std::vector<uint16_t>> & blocks)
+{
+    MPI_File file = openPopulationFile(path, comm, rows, cols);
+
+    // a row of a block, at cell offset of the whole raster
+    struct Segment
+    {
+        size_t offset;
+        int block;
+        int row;
+    };
+
+    std::vector<Segment> segments;
+
+    for (size_t b = 0; b < owned.size(); ++b)
+        for (int i = 0; i < owned[b].rows; ++i)
+            segments.push_back({(size_t) (owned[b].firstRow + i) * cols + owned[b].firstCol, (int) b, i});
+
+    std::sort(segments.begin(), segments.end(), [](const Segment & a, const Segment & b) {return a.offset < b.offset;});
+
+    std::vector<int> lengths(segments.size());
+    std::vector<MPI_Aint> displacements(segments.size());
+    size_t cells = 0;
+
+    for (size_t s = 0; s < segments.size(); ++s)
+    {
+        lengths[s] = owned[segments[s].block].cols;
+        displacements[s] = segments[s].offset * sizeof(uint16_t);
+        cells += lengths[s];
+    }
+
+    MPI_Datatype rowsType;
+    MPI_Type_create_hindexed(segments.size(), lengths.data(), displacements.data(), MPI_UNSIGNED_SHORT, &rowsType);
+    MPI_Type_commit(&rowsType);
+
+    std::vector<uint16_t> read(cells);
+
+    MPI_File_set_view(file, sizeof(PopulationHeader), MPI_UNSIGNED_SHORT, rowsType, "native", MPI_INFO_NULL);
+    MPI_File_read_all(file, read.data(), (int) cells, MPI_UNSIGNED_SHORT, MPI_STATUS_IGNORE);
+
+    MPI_Type_free(&rowsType);
+    MPI_File_close(&file);
+
+    blocks.resize(owned.size());
+    for (size_t b = 0; b < owned.size(); ++b) blocks[b].resize((size_t) owned[b].rows * owned[b].cols);
+
+    const uint16_t * from = read.data();
+
+    for (const Segment & segment : segments)
+    {
+        const Block & block = owned[segment.block];
+        std::copy(from, from + block.cols, blocks[segment.block].begin() + (size_t) segment.row * block.cols);
+        from += block.cols;
+    }
+}
+
+// Sequential read -------------------------------------------------------------------------------------
+//
+// The sequential build maps the raster instead of reading it, pages are faulted in while initialize()
+// walks the grid once from top to bottom.
+class MappedPopulation
+{
+    private:
+
+        int fd;
+
+        size_t length;
+
+        void * address;
+
+        const uint16_t * cells;
+
+        int cols;
+
+    public:
+
+        MappedPopulation(const std::string & path, int rows, int cols);
+
+        ~MappedPopulation();
+
+        MappedPopulation(const MappedPopulation &) = delete;
+        MappedPopulation & operator=(const MappedPopulation &) = delete;
+
+        uint16_t at(int i, int j) const {return this->cells[(size_t) i * this->cols + j];}
+
+};
+
+inline MappedPopulation::MappedPopulation(const std::string & path, int rows, int cols) : cols(cols)
+{
+    fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error("ERROR: Couldn't open/find population file " + path);
+
+    struct stat info;
+    if (fstat(fd, &info) != 0)
+    {
+        close(fd);
+        throw std::runtime_error("ERROR: Couldn't stat population file " + path);
+    }
+
+    length = info.st_size;
+
+    if (length < sizeof(PopulationHeader) + (size_t) rows * cols * sizeof(uint16_t))
+    {
+        close(fd);
+        throw std::runtime_error("ERROR: Population file is truncated");
+    }
+
+    address = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (address == MAP_FAILED)
+    {
+        close(fd);
+        throw std::runtime_error("ERROR: Couldn't map population file " + path);
+    }
+
+    madvise(address, length, MADV_SEQUENTIAL);
+
+    try { checkPopulationHeader(*(const PopulationHeader *) address, rows, cols); }
+    catch (...)
+    {
+        munmap(address, length);
+        close(fd);
+        throw;
+    }
+
+    cells = (const uint16_t *) ((const char *) address + sizeof(PopulationHeader));
+}
+
+inline MappedPopulation::~MappedPopulation()
+{
+    munmap(address, length);
+    close(fd);
+}
+
+#endif
@@ -0,0 +1,128 @@
+#ifndef RULES_HPP
+#define RULES_HPP
+
+#include <cstdlib> // rand
+
+#include "Settings.hpp"
+#include "Person.hpp"
+
+// Epidemic rules --------------------------------------------------------------------------------------
+//
+// The percentages that drive a generation and the per person cascade of update(), for kernels that
+// don't work on the readMatrix/writeMatrix globals of the builds.
+// -----------------------------------------------------------------------------------------------------
+
+struct Rules
+{
+    int infectionPercentage;
+    int immunityPercentage;
+    int loseImmunityPercentage;
+    int vaccinationPercentage;
+    int deathPercentage;
+};
+
+inline Rules rulesFrom(const Settings & settings)
+{
+    Rules rules;
+
+    rules.infectionPercentage = settings.getInfectionPercentage();
+    rules.immunityPercentage = settings.getImmunityPercentage();
+    rules.loseImmunityPercentage = settings.getLoseImmunityPercentage();
+    rules.vaccinationPercentage = settings.getVaccinationPercentage();
+    rules.deathPercentage = settings.getDeathPercentage();
+
+    return rules;
+}
+
+// a neighbour counts as infected once it is past the second day of incubation
+inline bool isInfectious(const Person & person)
+{
+    return person.values.isInfected && person.values.daysOfIncubation >= 2;
+}
+
+inline bool isVaccinated(const Person & person)
+{
+    return person.values.isVaccinated;
+}
+
+// rand() as a random source of the kernels, see CounterRng.hpp for the other one
+struct StandardRandom
+{
+    inline int operator()() const {return rand();}
+};
+
+// next state of person given how many of its 8 neighbours are infectious and vaccinated; vaccinated()
+// says whether the person gets vaccinated spontaneously today and is only asked when the cascade gets
+// to that roll (see GeometricSkip.hpp), every other roll draws from random
+template <typename Vaccinated, typename Random = StandardRandom>
+inline Person nextPerson(Person person, short infectedNeighbours, short vaccinatedNeighbours, const Rules & rules,
+                         Vaccinated && vaccinated, Random random = Random())
+{
+    Person next = person;
+
+    if (person.values.isDead || person.values.isVaccinated)
+        return next;
+
+    // if the person is infected
+    if (person.values.isInfected && !person.values.isImmune)
+    {
+        if (person.values.daysOfIncubation < 3)
+        {
+            ++next.values.daysOfIncubation;
+            return next;
+        }
+
+        if (person.values.daysOfInfection < 7)
+        {
+            next.values.daysOfIncubation = 0;
+            ++next.values.daysOfInfection;
+        }
+        else if (random()%100 < rules.immunityPercentage)
+        {
+            next.values.isInfected = false;
+            next.values.isImmune = true;
+        }
+
+        int deathPercentage = person.values.age >= 65 ? rules.deathPercentage :
+                              person.values.age > 25 ? rules.deathPercentage / 2 : rules.deathPercentage / 4;
+
+        if (random()%100 < deathPercentage)
+        {
+            next.values.isInfected = false;
+            next.values.isDead = true;
+        }
+
+        return next;
+    }
+
+    // if the person is not infected
+    if (infectedNeighbours > 0 &&
+        random()%100 < rules.infectionPercentage * infectedNeighbours &&
+        person.values.isImmune == false)
+    {
+        next.values.isInfected = true;
+        return next;
+    }
+
+    if (vaccinated())
+    {
+        next.values.isVaccinated = true;
+        return next;
+    }
+
+    if (vaccinatedNeighbours > 0 &&
+        random()%250 < rules.vaccinationPercentage * vaccinatedNeighbours)
+    {
+        next.values.isVaccinated = true;
+        return next;
+    }
+
+    if (random()%100 < rules.loseImmunityPercentage)
+    {
+        next.values.isImmune = false;
+    }
+
+    return next;
+}
+
+#endif
@@ -3,145 +3,494 @@
 
 #include <fstream> //ifstream
 #include <iostream> //cout
+#include <string> //string
+#include <vector> //vector
+#include <cstring> //strcmp, strncmp, memcpy
+#include <cstdlib> //getenv
+#include <cctype> //isupper, toupper
+#include <ctime> //time
+#include <cstdio> //fprintf
+#include <stdexcept> //exception, invalid_argument
+
+#include <mpich/mpi.h>
 
 #include "json.hpp" // parsing json file
 using json = nlohmann::json;
 
+#define defaultConfigPath "config/default.json"
+#define settingsPathLength 256
+#define settingsEnvironmentPrefix "COVID19_"
+
 struct rgb{int r; int g; int b;};
 
-class Settings
+// Every parameter of a run, kept as plain data so it can be broadcast as a single block of bytes
+struct SettingsParameters
 {
+    int numberOfGenerations;
 
-    private:
+    int matrixSize;
+
+    // grid extents, matrixSize when 0
+    int rows;
+
+    int cols;
+
+    int squareSize;
+
+    int vaccinationPercentage;
+
+    int infectionPercentage;
+
+    int immunityPercentage;
+
+    int loseImmunityPercentage;
+
+    int deathPercentage;
+
+    rgb defaultPersonColor;
+
+    rgb incubationColor;
+
+    rgb immuneColor;
+
+    rgb infectedColor;
+
+    rgb deadColor;
 
-        int numberOfGenerations;
+    rgb vaccinatedColor;
 
-        int matrixSize;
+    int millisecondsToWaitForEachGeneration;
 
-        int squareSize;
+    char populationFile[settingsPathLength];
 
-        int vaccinationPercentage;
+    // seed of the generated population, 0 draws one from the clock
+    int seed;
 
-        int infectionPercentage;
+    // where the first infected people are, see Outbreak.hpp
+    char outbreak[settingsPathLength];
 
-        int immunityPercentage;
+    int outbreakSeeds;
 
-        int loseImmunityPercentage;
+    int outbreakClusters;
 
-        int deathPercentage;
+    int outbreakRadius;
 
-        rgb defaultPersonColor;
+    char outbreakFile[settingsPathLength];
 
-        rgb incubationColor;
+    char mappedGridDirectory[settingsPathLength];
 
-        rgb immuneColor;
+    char historyFile[settingsPathLength];
 
-        rgb infectedColor;
+    int historyKeyframeInterval;
 
-        rgb deadColor;
+    int tileSize;
 
-        rgb vaccinatedColor;
+    int generationsPerTile;
 
-        int millisecondsToWaitForEachGeneration;
+    int rebalanceInterval;
+
+    char haloExchange[settingsPathLength];
+
+    int ensembleGroupSize;
+
+    int ensembleReplicas;
+
+    char ensembleSweepField[settingsPathLength];
+
+    int ensembleSweepStep;
+
+    char ensembleOutput[settingsPathLength];
+};
+
+class Settings
+{
+
+    private:
+
+        SettingsParameters parameters;
 
 
     public:
 
         Settings();
 
+        // The json file holds the defaults, every field can then be overridden by an environment
+        // variable (COVID19_MATRIX_SIZE=240) and then by a command line flag (--matrixSize=240 or
+        // --matrixSize 240). Colors are given as r,g,b.
+        Settings(const std::string & path, int argc = 0, char * argv[] = NULL);
+
+        // Only the root of comm opens and parses the config file, everyone else gets the parsed
+        // parameters through one broadcast. The config path is taken from --config <path>.
+        static Settings load(int argc, char * argv[], MPI_Comm comm, int root = 0);
+
+        static std::string configPath(int argc, char * argv[]);
+
+        static const std::vector<std::string> & fieldNames();
+
         // Getters -------------------------------------------------------------------------------------
 
-        int getNumberOfGenerations() const {return this->numberOfGenerations;}
+        int getNumberOfGenerations() const {return this->parameters.numberOfGenerations;}
+
+        int getSquareSize() const {return this->parameters.squareSize;}
+
+        int getMatrixSize() const {return this->parameters.matrixSize;}
+
+        int getRows() const {return this->parameters.rows ? this->parameters.rows : this->parameters.matrixSize;}
+
+        int getCols() const {return this->parameters.cols ? this->parameters.cols : this->parameters.matrixSize;}
+
+        int getVaccinationPercentage() const {return this->parameters.vaccinationPercentage;}
+
+        int getInfectionPercentage() const {return this->parameters.infectionPercentage;}
+
+        int getImmunityPercentage() const {return this->parameters.immunityPercentage;}
+
+        int getLoseImmunityPercentage() const {return this->parameters.loseImmunityPercentage;}
+
+        int getDeathPercentage() const {return this->parameters.deathPercentage;}
+
+        rgb getDefaultPersonColor() const {return this->parameters.defaultPersonColor;}
+
+        rgb getIncubationColor() const {return this->parameters.incubationColor;}
+
+        rgb getImmuneColor() const {return this->parameters.immuneColor;}
+
+        rgb getInfectedColor() const {return this->parameters.infectedColor;}
+
+        rgb getDeadColor() const {return this->parameters.deadColor;}
+
+        rgb getVaccinatedColor() const {return this->parameters.vaccinatedColor;}
 
-        int getSquareSize() const {return this->squareSize;}
+        int getMillisecodsToWaitForEachGeneration() const {return this->parameters.millisecondsToWaitForEachGeneration;}
 
-        int getMatrixSize() const {return this->matrixSize;}
+        std::string getPopulationFile() const {return this->parameters.populationFile;}
 
-        int getVaccinationPercentage() const {return this->vaccinationPercentage;}
+        int getSeed() const {return this->parameters.seed;}
 
-        int getInfectionPercentage() const {return this->infectionPercentage;}
+        std::string getOutbreak() const {return this->parameters.outbreak;}
 
-        int getImmunityPercentage() const {return this->immunityPercentage;}
+        int getOutbreakSeeds() const {return this->parameters.outbreakSeeds;}
 
-        int getLoseImmunityPercentage() const {return this->loseImmunityPercentage;}
+        int getOutbreakClusters() const {return this->parameters.outbreakClusters;}
 
-        int getDeathPercentage() const {return this->deathPercentage;}
+        int getOutbreakRadius() const {return this->parameters.outbreakRadius;}
 
-        rgb getDefaultPersonColor() const {return this->defaultPersonColor;}
+        std::string getOutbreakFile() const {return this->parameters.outbreakFile;}
 
-        rgb getIncubationColor() const {return this->incubationColor;}
+        std::string getMappedGridDirectory() const {return this->parameters.mappedGridDirectory;}
 
-        rgb getImmuneColor() const {return this->immuneColor;}
+        std::string getHistoryFile() const {return this->parameters.historyFile;}
 
-        rgb getInfectedColor() const {return this->infectedColor;}
+        int getHistoryKeyframeInterval() const {return this->parameters.historyKeyframeInterval;}
 
-        rgb getDeadColor() const {return this->deadColor;}
+        int getTileSize() const {return this->parameters.tileSize;}
 
-        rgb getVaccinatedColor() const {return this->vaccinatedColor;}
+        int getGenerationsPerTile() const {return this->parameters.generationsPerTile;}
 
-        int getMillisecodsToWaitForEachGeneration() const {return this->millisecondsToWaitForEachGeneration;}
+        int getRebalanceInterval() const {return this->parameters.rebalanceInterval;}
+
+        std::string getHaloExchange() const {return this->parameters.haloExchange;}
+
+        int getEnsembleGroupSize() const {return this->parameters.ensembleGroupSize;}
+
+        int getEnsembleReplicas() const {return this->parameters.ensembleReplicas;}
+
+        std::string getEnsembleSweepField() const {return this->parameters.ensembleSweepField;}
+
+        int getEnsembleSweepStep() const {return this->parameters.ensembleSweepStep;}
+
+        std::string getEnsembleOutput() const {return this->parameters.ensembleOutput;}
+
+        // integer parameter by its json name, NULL if there is no such integer field
+        int * integerField(const std::string & name);
 
         // ---------------------------------------------------------------------------------------------
 
         // Utils ---------------------------------------------------------------------------------------
         inline int checkRGBValue(int value) const;
         inline int checkPositive(int value) const;
+        inline void copyPath(char * destination, const std::string & value) const;
+        static inline json parseOverride(const json & current, const std::string & value);
+        static inline void applyOverrides(json & jsonSettings, int argc, char * argv[]);
 
 };
 
-Settings::Settings()
+inline Settings::Settings()
+{
+    memset(&parameters, 0, sizeof(parameters));
+}
+
+inline Settings::Settings(const std::string & path, int argc, char * argv[]) : Settings()
 {
 
     // Read json settings file -------------------------------------------------------------------------
-    std::ifstream settings("config/default.json");
+    std::ifstream settings(path);
+
+    if(!settings){ throw std::runtime_error("ERROR: Couldn't open/find settings file " + path); }
 
-    if(!settings){ throw std::runtime_error("ERROR: Couldn't open/find settings.json file"); }
-    
     json jsonSettings;
     settings >> jsonSettings;
+
+    applyOverrides(jsonSettings, argc, argv);
     //----------------------------------------------------------------------------------------------------
 
-    numberOfGenerations = checkPositive(jsonSettings["numberOfGenerations"]);
+    parameters.numberOfGenerations = checkPositive(jsonSettings["numberOfGenerations"]);
+
+    parameters.matrixSize = checkPositive(jsonSettings["matrixSize"]);
+
+    // optional: rectangular grids, 0 takes matrixSize
+    parameters.rows = checkPositive(jsonSettings.value("rows", 0));
+    parameters.cols = checkPositive(jsonSettings.value("cols", 0));
+
+    parameters.squareSize = checkPositive(jsonSettings["squareSize"]);
+
+    parameters.vaccinationPercentage = checkPositive(jsonSettings["vaccinationPercentage"]);
 
-    matrixSize = checkPositive(jsonSettings["matrixSize"]);
+    parameters.infectionPercentage = checkPositive(jsonSettings["infectionPercentage"]);
 
-    squareSize = checkPositive(jsonSettings["squareSize"]);
+    parameters.immunityPercentage = checkPositive(jsonSettings["immunityPercentage"]);
 
-    vaccinationPercentage = checkPositive(jsonSettings["vaccinationPercentage"]);
+    parameters.loseImmunityPercentage = checkPositive(jsonSettings["loseImmunityPercentage"]);
 
-    infectionPercentage = checkPositive(jsonSettings["infectionPercentage"]);
+    parameters.deathPercentage = checkPositive(jsonSettings["deathPercentage"]);
 
-    immunityPercentage = checkPositive(jsonSettings["immunityPercentage"]);
+    parameters.defaultPersonColor.r = checkRGBValue(jsonSettings["defaultPersonColor"][0]);
+    parameters.defaultPersonColor.g = checkRGBValue(jsonSettings["defaultPersonColor"][1]);
+    parameters.defaultPersonColor.b = checkRGBValue(jsonSettings["defaultPersonColor"][2]);
 
-    loseImmunityPercentage = checkPositive(jsonSettings["loseImmunityPercentage"]);
+    parameters.incubationColor.r = checkRGBValue(jsonSettings["incubationColor"][0]);
+    parameters.incubationColor.g = checkRGBValue(jsonSettings["incubationColor"][1]);
+    parameters.incubationColor.b = checkRGBValue(jsonSettings["incubationColor"][2]);
 
-    deathPercentage = checkPositive(jsonSettings["deathPercentage"]);
+    parameters.immuneColor.r = checkRGBValue(jsonSettings["immuneColor"][0]);
+    parameters.immuneColor.g = checkRGBValue(jsonSettings["immuneColor"][1]);
+    parameters.immuneColor.b = checkRGBValue(jsonSettings["immuneColor"][2]);
 
-    defaultPersonColor.r = checkRGBValue(jsonSettings["defaultPersonColor"][0]);
-    defaultPersonColor.g = checkRGBValue(jsonSettings["defaultPersonColor"][1]);
-    defaultPersonColor.b = checkRGBValue(jsonSettings["defaultPersonColor"][2]);
+    parameters.infectedColor.r = checkRGBValue(jsonSettings["infectedColor"][0]);
+    parameters.infectedColor.g = checkRGBValue(jsonSettings["infectedColor"][1]);
+    parameters.infectedColor.b = checkRGBValue(jsonSettings["infectedColor"][2]);
 
-    incubationColor.r = checkRGBValue(jsonSettings["incubationColor"][0]);
-    incubationColor.g = checkRGBValue(jsonSettings["incubationColor"][1]);
-    incubationColor.b = checkRGBValue(jsonSettings["incubationColor"][2]);
+    parameters.deadColor.r = checkRGBValue(jsonSettings["deadColor"][0]);
+    parameters.deadColor.g = checkRGBValue(jsonSettings["deadColor"][1]);
+    parameters.deadColor.b = checkRGBValue(jsonSettings["deadColor"][2]);
 
-    immuneColor.r = checkRGBValue(jsonSettings["immuneColor"][0]);
-    immuneColor.g = checkRGBValue(jsonSettings["immuneColor"][1]);
-    immuneColor.b = checkRGBValue(jsonSettings["immuneColor"][2]);
+    parameters.vaccinatedColor.r = checkRGBValue(jsonSettings["vaccinatedColor"][0]);
+    parameters.vaccinatedColor.g = checkRGBValue(jsonSettings["vaccinatedColor"][1]);
+    parameters.vaccinatedColor.b = checkRGBValue(jsonSettings["vaccinatedColor"][2]);
 
-    infectedColor.r = checkRGBValue(jsonSettings["infectedColor"][0]);
-    infectedColor.g = checkRGBValue(jsonSettings["infectedColor"][1]);
-    infectedColor.b = checkRGBValue(jsonSettings["infectedColor"][2]);
+    parameters.millisecondsToWaitForEachGeneration = checkPositive(jsonSettings["millisecondsToWaitForEachGeneration"]);
 
-    deadColor.r = checkRGBValue(jsonSettings["deadColor"][0]);
-    deadColor.g = checkRGBValue(jsonSettings["deadColor"][1]);
-    deadColor.b = checkRGBValue(jsonSettings["deadColor"][2]);
+    // optional, an empty path keeps the random population
+    copyPath(parameters.populationFile, jsonSettings.value("populationFile", ""));
 
-    vaccinatedColor.r = checkRGBValue(jsonSettings["vaccinatedColor"][0]);
-    vaccinatedColor.g = checkRGBValue(jsonSettings["vaccinatedColor"][1]);
-    vaccinatedColor.b = checkRGBValue(jsonSettings["vaccinatedColor"][2]);
+    // picked here so that every rank gets the same one with the broadcast of the parameters
+    parameters.seed = checkPositive(jsonSettings.value("seed", 0));
 
-    millisecondsToWaitForEachGeneration = checkPositive(jsonSettings["millisecondsToWaitForEachGeneration"]);
+    if (parameters.seed == 0) parameters.seed = 1 + time(NULL) % 2147483646;
+
+    // generated populations only, a population file brings its own infected people
+    copyPath(parameters.outbreak, jsonSettings.value("outbreak", "centre"));
+
+    if (strcmp(parameters.outbreak, "centre") != 0 && strcmp(parameters.outbreak, "random") != 0 &&
+        strcmp(parameters.outbreak, "clustered") != 0 && strcmp(parameters.outbreak, "file") != 0)
+        throw std::invalid_argument("ERROR: outbreak must be centre, random, clustered or file");
+
+    parameters.outbreakSeeds = checkPositive(jsonSettings.value("outbreakSeeds", 1));
+
+    parameters.outbreakClusters = checkPositive(jsonSettings.value("outbreakClusters", 1));
+
+    if (parameters.outbreakClusters < 1)
+        throw std::invalid_argument("ERROR: outbreakClusters must be at least 1");
+
+    parameters.outbreakRadius = checkPositive(jsonSettings.value("outbreakRadius", 5));
+
+    copyPath(parameters.outbreakFile, jsonSettings.value("outbreakFile", ""));
+
+    if (strcmp(parameters.outbreak, "file") == 0 && !parameters.outbreakFile[0])
+        throw std::invalid_argument("ERROR: outbreak file needs an outbreakFile");
+
+    // optional, sequential build only: keep the grids in file-backed mappings inside this directory
+    copyPath(parameters.mappedGridDirectory, jsonSettings.value("mappedGridDirectory", ""));
+
+    // optional, sequential build only: log every generation to this file (see History.hpp)
+    copyPath(parameters.historyFile, jsonSettings.value("historyFile", ""));
+
+    parameters.historyKeyframeInterval = checkPositive(jsonSettings.value("historyKeyframeInterval", 100));
+
+    // optional, sequential build: update tileSize * tileSize tiles instead of whole rows, 0 keeps rows;
+    // hilbert tiles build: size of the tiles handed out to the ranks, 0 picks about 16 tiles per rank
+    parameters.tileSize = checkPositive(jsonSettings.value("tileSize", 0));
+
+    // generations a tile is advanced before moving to the next one (temporal blocking)
+    parameters.generationsPerTile = checkPositive(jsonSettings.value("generationsPerTile", 1));
+
+    if (parameters.generationsPerTile < 1)
+        throw std::invalid_argument("ERROR: generationsPerTile must be at least 1");
+
+    // optional, parallel builds only: resize the strips or blocks by measured update time every this
+    // many generations (see Balance.hpp), 0 keeps the initial split
+    parameters.rebalanceInterval = checkPositive(jsonSettings.value("rebalanceInterval", 0));
+
+    // 2D build only: how halos travel, "messages", "shared" to read them straight from the memory of
+    // the ranks on the same node or "put" to write them in the memory of the neighbours with MPI_Put
+    copyPath(parameters.haloExchange, jsonSettings.value("haloExchange", "messages"));
+
+    if (strcmp(parameters.haloExchange, "messages") != 0 && strcmp(parameters.haloExchange, "shared") != 0 &&
+        strcmp(parameters.haloExchange, "put") != 0)
+        throw std::invalid_argument("ERROR: haloExchange must be messages, shared or put");
+
+    // optional, see Ensemble.hpp: 0 runs a single simulation on every rank
+    parameters.ensembleGroupSize = checkPositive(jsonSettings.value("ensembleGroupSize", 0));
+
+    parameters.ensembleReplicas = checkPositive(jsonSettings.value("ensembleReplicas", 1));
+
+    copyPath(parameters.ensembleSweepField, jsonSettings.value("ensembleSweepField", ""));
+
+    parameters.ensembleSweepStep = jsonSettings.value("ensembleSweepStep", 0);
+
+    copyPath(parameters.ensembleOutput, jsonSettings.value("ensembleOutput", "ensemble"));
+
+    if (parameters.ensembleSweepField[0] && !integerField(parameters.ensembleSweepField))
+        throw std::invalid_argument("ERROR: ensembleSweepField must name an integer setting");
+}
+
+inline Settings Settings::load(int argc, char * argv[], MPI_Comm comm, int root)
+{
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+
+    Settings settings;
+
+    // a bad config would otherwise leave the other ranks waiting in the broadcast
+    if (rank == root)
+    {
+        try { settings = Settings(configPath(argc, argv), argc, argv); }
+        catch (const std::exception & error)
+        {
+            fprintf(stderr, "%s\n", error.what());
+            MPI_Abort(comm, 1);
+        }
+    }
+
+    MPI_Bcast(&settings.parameters, sizeof(SettingsParameters), MPI_BYTE, root, comm);
+
+    return settings;
+}
+
+inline std::string Settings::configPath(int argc, char * argv[])
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--config") == 0 && i + 1 < argc) return argv[i + 1];
+        if (strncmp(argv[i], "--config=", 9) == 0) return argv[i] + 9;
+    }
+
+    return defaultConfigPath;
+}
+
+inline const std::vector<std::string> & Settings::fieldNames()
+{
+    static const std::vector<std::string> names = {
+        "numberOfGenerations", "matrixSize", "rows", "cols", "squareSize", "vaccinationPercentage", "infectionPercentage",
+        "immunityPercentage", "loseImmunityPercentage", "deathPercentage", "defaultPersonColor",
+        "incubationColor", "immuneColor", "infectedColor", "deadColor", "vaccinatedColor",
+        "millisecondsToWaitForEachGeneration", "populationFile", "seed", "outbreak", "outbreakSeeds",
+        "outbreakClusters", "outbreakRadius", "outbreakFile", "mappedGridDirectory", "historyFile",
+        "historyKeyframeInterval", "tileSize", "generationsPerTile", "rebalanceInterval", "haloExchange",
+        "ensembleGroupSize", "ensembleReplicas", "ensembleSweepField", "ensembleSweepStep", "ensembleOutput"
+    };
+
+    return names;
+}
+
+inline int * Settings::integerField(const std::string & name)
+{
+    static const std::pair<const char *, int SettingsParameters::*> fields[] = {
+        {"numberOfGenerations", &SettingsParameters::numberOfGenerations},
+        {"matrixSize", &SettingsParameters::matrixSize},
+        {"rows", &SettingsParameters::rows},
+        {"cols", &SettingsParameters::cols},
+        {"squareSize", &SettingsParameters::squareSize},
+        {"vaccinationPercentage", &SettingsParameters::vaccinationPercentage},
+        {"infectionPercentage", &SettingsParameters::infectionPercentage},
+        {"immunityPercentage", &SettingsParameters::immunityPercentage},
+        {"loseImmunityPercentage", &SettingsParameters::loseImmunityPercentage},
+        {"deathPercentage", &SettingsParameters::deathPercentage},
+        {"millisecondsToWaitForEachGeneration", &SettingsParameters::millisecondsToWaitForEachGeneration},
+        {"seed", &SettingsParameters::seed},
+        {"outbreakSeeds", &SettingsParameters::outbreakSeeds},
+        {"outbreakClusters", &SettingsParameters::outbreakClusters},
+        {"outbreakRadius", &SettingsParameters::outbreakRadius}
+    };
+
+    for (auto & field : fields)
+    {
+        if (name == field.first) return &(parameters.*field.second);
+    }
+
+    return NULL;
+}
+
+inline json Settings::parseOverride(const json & current, const std::string & value)
+{
+    // string fields (paths) are never reinterpreted, a directory called 100 stays a string
+    if (current.is_string()) return json(value);
+
+    // r,g,b is shorthand for a color array
+    std::string text = value.find(',') != std::string::npos && value[0] != '[' ? "[" + value + "]" : value;
+
+    json parsed = json::parse(text, nullptr, false);
+
+    // anything that isn't valid json (paths) is taken as a plain string
+    if (parsed.is_discarded()) return json(value);
+
+    return parsed;
+}
+
+inline void Settings::applyOverrides(json & jsonSettings, int argc, char * argv[])
+{
+    // Environment variables -----------------------------------------------------------------------------
+    for (const std::string & name : fieldNames())
+    {
+        std::string variable = settingsEnvironmentPrefix;
+
+        for (char c : name)
+        {
+            if (isupper(c)) variable += '_';
+            variable += toupper(c);
+        }
+
+        const char * value = getenv(variable.c_str());
+        if (value) jsonSettings[name] = parseOverride(jsonSettings.value(name, json()), value);
+    }
+
+    // Command line --------------------------------------------------------------------------------------
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strncmp(argv[i], "--", 2) != 0) continue;
+
+        std::string flag = argv[i] + 2;
+        std::string value;
+
+        size_t equal = flag.find('=');
+
+        if (equal != std::string::npos)
+        {
+            value = flag.substr(equal + 1);
+            flag = flag.substr(0, equal);
+        }
+        else if (i + 1 < argc) value = argv[++i];
+        else throw std::invalid_argument("ERROR: Missing value for --" + flag);
+
+        if (flag == "config") continue;
+
+        bool known = false;
+        for (const std::string & name : fieldNames()) known = known || name == flag;
+
+        if (!known) throw std::invalid_argument("ERROR: Unknown setting --" + flag);
+
+        jsonSettings[flag] = parseOverride(jsonSettings.value(flag, json()), value);
+    }
 }
 
 inline int Settings::checkRGBValue(int value) const
@@ -158,4 +507,12 @@ inline int Settings::checkPositive(int value) const
     throw std::range_error("ERROR: Passed a negative value, positive expected.");
 }
 
-#endif
\ No newline at end of file
+inline void Settings::copyPath(char * destination, const std::string & value) const
+{
+    if (value.size() >= settingsPathLength)
+        throw std::length_error("ERROR: Paths in the settings file must be shorter than 256 characters");
+
+    memcpy(destination, value.c_str(), value.size() + 1);
+}
+
+#endif
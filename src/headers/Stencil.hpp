@@ -0,0 +1,61 @@
+#ifndef STENCIL_HPP
+#define STENCIL_HPP
+
+#include "Person.hpp"
+#include "Rules.hpp"
+#include "Grid.hpp"
+#include "GeometricSkip.hpp"
+
+// Stencil kernel --------------------------------------------------------------------------------------
+//
+// The update of a generation, shared by every build. updateStencil() sweeps rows [firstRow, lastRow)
+// of columns [firstCol, lastCol) of a grid in the order of its layout, counts the infectious and
+// vaccinated neighbours of every person with the column sums of ColumnSums.hpp and stores what next()
+// makes of them:
+//
+//      read(i, j)  -> the state of a person, also called one person around the region
+//      write(i, j) -> where the next state of that person goes
+//      next(state, i, j, infectedNeighbours, vaccinatedNeighbours) -> the next state
+//
+// States are Persons or anything else with isInfectious() and isVaccinated() overloads (see
+// CompactState.hpp). The way a build reaches its people (halos, wrapped rows, tiles, scratch grids)
+// lives in read and write and the way a person moves on (cascade, transition table, counter based
+// rolls) in next, so a change to the sweep lands in every build. Builds only reproduce each other
+// when they also share next(): the transition table follows the same rules as the cascade but skips
+// the rolls that can't succeed, so it draws a different rand() stream from the same seed.
+// -----------------------------------------------------------------------------------------------------
+
+template <typename Layout, typename Read, typename Write, typename Next>
+inline void updateStencil(const Grid<Layout> & grid, int firstRow, int lastRow, int firstCol, int lastCol,
+                          Read read, Write write, Next next)
+{
+    grid.sweep(firstRow, lastRow, firstCol, lastCol, read,
+        [&read, &write, &next](int i, int j, short infectedNeighbours, short vaccinatedNeighbours)
+        {
+            write(i, j) = next(read(i, j), i, j, infectedNeighbours, vaccinatedNeighbours);
+        });
+}
+
+// next() going through the cascade of nextPerson() with random numbers from rand()
+template <typename Vaccinated>
+inline auto cascade(const Rules & rules, Vaccinated & vaccinated)
+{
+    return [&rules, &vaccinated](const Person & person, int, int, short infectedNeighbours, short vaccinatedNeighbours)
+    {
+        return nextPerson(person, infectedNeighbours, vaccinatedNeighbours, rules, vaccinated);
+    };
+}
+
+// the same with every roll, spontaneous vaccinations included, drawn from random instead of rand()
+template <typename Random>
+inline auto cascade(const Rules & rules, GeometricSkip & vaccinated, Random & random)
+{
+    return [&rules, &vaccinated, &random](const Person & person, int, int, short infectedNeighbours, short vaccinatedNeighbours)
+    {
+        return nextPerson(person, infectedNeighbours, vaccinatedNeighbours, rules,
+                          [&vaccinated, &random]() {return vaccinated.next(random);},
+                          [&random]() {return random();});
+    };
+}
+
+#endif
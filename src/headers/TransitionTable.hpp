@@ -0,0 +1,235 @@
+#ifndef TRANSITION_TABLE_HPP
+#define TRANSITION_TABLE_HPP
+
+#include <cstdint> // uint16_t
+#include <cstdlib> // rand
+#include <vector> // vector
+
+#include "Person.hpp"
+#include "Rules.hpp"
+
+// Transition table ------------------------------------------------------------------------------------
+//
+// The cascade of nextPerson() precomputed for every compact state (the 9 bits of flags and day
+// counters) and age band. An entry holds the deterministic next state and the ordered random rolls
+// that may still change it; a roll succeeds when random() % modulus is below its threshold and then
+// clears and sets bits of the state, optionally ending the cascade. Spontaneous vaccination is not
+// rolled but asked to the caller, see GeometricSkip.hpp, its roll has a modulus of 0.
+//
+// The only thresholds that depend on the neighbourhood are linear in the counts (infection *
+// infectedNeighbours and vaccination * vaccinatedNeighbours), so instead of one entry per count the
+// rolls carry a coefficient for each count, which keeps the table at 1536 entries.
+// -----------------------------------------------------------------------------------------------------
+
+#define transitionStates 512 // 4 flags, 2 bits of incubation and 3 of infection
+#define transitionAgeBands 3 // up to 25, up to 64 and 65 or older
+#define transitionMaxRolls 4
+
+// bits of the compact state
+#define stateInfected 0x001
+#define stateImmune 0x002
+#define stateDead 0x004
+#define stateVaccinated 0x008
+#define stateIncubationShift 4
+#define stateIncubation 0x030
+#define stateInfectionShift 6
+#define stateInfection 0x1c0
+
+struct TransitionRoll
+{
+    int modulus; // 0 asks the caller instead, see next()
+
+    // random() % modulus has to be below threshold + perInfected * infected + perVaccinated * vaccinated
+    int threshold;
+    int perInfected;
+    int perVaccinated;
+
+    uint16_t clear;
+    uint16_t set;
+    bool stop;
+};
+
+struct Transition
+{
+    uint16_t next;
+    uint8_t rolls;
+    TransitionRoll roll[transitionMaxRolls];
+};
+
+class TransitionTable
+{
+    private:
+
+        std::vector<Transition> transitions;
+
+        // Person::all of every compact state with age 0
+        std::vector<unsigned short> decoded;
+
+        // bits of Person::all that belong to the compact state
+        unsigned short stateMask;
+
+        void build(const Rules & rules);
+
+        static inline void addRoll(Transition & transition, int modulus, int threshold, int perInfected, int perVaccinated,
+                                   uint16_t clear, uint16_t set, bool stop);
+
+    public:
+
+        TransitionTable(const Rules & rules);
+
+        static inline int encode(const Person & person)
+        {
+            return person.values.isInfected |
+                   person.values.isImmune << 1 |
+                   person.values.isDead << 2 |
+                   person.values.isVaccinated << 3 |
+                   person.values.daysOfIncubation << stateIncubationShift |
+                   person.values.daysOfInfection << stateInfectionShift;
+        }
+
+        static inline int ageBand(const Person & person)
+        {
+            return (person.values.age > 25) + (person.values.age >= 65);
+        }
+
+        // same contract as nextPerson()
+        template <typename Vaccinated, typename Random = StandardRandom>
+        inline Person next(Person person, short infectedNeighbours, short vaccinatedNeighbours, Vaccinated && vaccinated,
+                           Random random = Random()) const
+        {
+            int state = nextState(ageBand(person), encode(person), infectedNeighbours, vaccinatedNeighbours, vaccinated, random);
+
+            person.all = (person.all & ~stateMask) | decoded[state];
+            return person;
+        }
+
+        // next compact state of a person in age band
+        template <typename Vaccinated, typename Random = StandardRandom>
+        inline int nextState(int band, int state, short infectedNeighbours, short vaccinatedNeighbours, Vaccinated && vaccinated,
+                             Random random = Random()) const
+        {
+            const Transition & transition = transitions[band * transitionStates + state];
+
+            state = transition.next;
+
+            for (int r = 0; r < transition.rolls; ++r)
+            {
+                const TransitionRoll & roll = transition.roll[r];
+
+                int threshold = roll.threshold + roll.perInfected * infectedNeighbours + roll.perVaccinated * vaccinatedNeighbours;
+
+                if (roll.modulus == 0 ? vaccinated() : threshold > 0 && random() % roll.modulus < threshold)
+                {
+                    state = (state & ~roll.clear) | roll.set;
+                    if (roll.stop) break;
+                }
+            }
+
+            return state;
+        }
+
+        // person with the given compact state and age
+        inline Person decode(int state, int age) const
+        {
+            Person person;
+            person.all = decoded[state];
+            person.values.age = age;
+            return person;
+        }
+
+};
+
+inline TransitionTable::TransitionTable(const Rules & rules) : transitions(transitionAgeBands * transitionStates), decoded(transitionStates)
+{
+    for (int state = 0; state < transitionStates; ++state)
+    {
+        Person person;
+        person.all = 0;
+
+        person.values.isInfected = (state & stateInfected) != 0;
+        person.values.isImmune = (state & stateImmune) != 0;
+        person.values.isDead = (state & stateDead) != 0;
+        person.values.isVaccinated = (state & stateVaccinated) != 0;
+        person.values.daysOfIncubation = (state & stateIncubation) >> stateIncubationShift;
+        person.values.daysOfInfection = (state & stateInfection) >> stateInfectionShift;
+
+        decoded[state] = person.all;
+    }
+
+    stateMask = decoded[transitionStates - 1];
+
+    build(rules);
+}
+
+inline void TransitionTable::addRoll(Transition & transition, int modulus, int threshold, int perInfected, int perVaccinated,
+                                     uint16_t clear, uint16_t set, bool stop)
+{
+    // a roll that can never succeed is left out, it would only burn a random number
+    if (threshold <= 0 && perInfected <= 0 && perVaccinated <= 0) return;
+
+    TransitionRoll & roll = transition.roll[transition.rolls++];
+
+    roll.modulus = modulus;
+    roll.threshold = threshold;
+    roll.perInfected = perInfected;
+    roll.perVaccinated = perVaccinated;
+    roll.clear = clear;
+    roll.set = set;
+    roll.stop = stop;
+}
+
+inline void TransitionTable::build(const Rules & rules)
+{
+    const int deathPercentage[transitionAgeBands] = {rules.deathPercentage / 4, rules.deathPercentage / 2, rules.deathPercentage};
+
+    for (int band = 0; band < transitionAgeBands; ++band)
+    {
+        for (int state = 0; state < transitionStates; ++state)
+        {
+            Transition & transition = transitions[band * transitionStates + state];
+
+            transition.next = state;
+            transition.rolls = 0;
+
+            int incubation = (state & stateIncubation) >> stateIncubationShift;
+            int infection = (state & stateInfection) >> stateInfectionShift;
+
+            if (state & (stateDead | stateVaccinated))
+                continue;
+
+            // if the person is infected
+            if ((state & stateInfected) && !(state & stateImmune))
+            {
+                if (incubation < 3)
+                {
+                    transition.next = (state & ~stateIncubation) | ((incubation + 1) << stateIncubationShift);
+                    continue;
+                }
+
+                if (infection < 7)
+                {
+                    transition.next = (state & ~(stateIncubation | stateInfection)) | ((infection + 1) << stateInfectionShift);
+                }
+                else
+                {
+                    addRoll(transition, 100, rules.immunityPercentage, 0, 0, stateInfected, stateImmune, false);
+                }
+
+                addRoll(transition, 100, deathPercentage[band], 0, 0, stateInfected, stateDead, true);
+                continue;
+            }
+
+            // if the person is not infected
+            if (!(state & stateImmune))
+                addRoll(transition, 100, 0, rules.infectionPercentage, 0, 0, stateInfected, true);
+
+            addRoll(transition, 0, rules.vaccinationPercentage, 0, 0, 0, stateVaccinated, true);
+            addRoll(transition, 250, 0, 0, rules.vaccinationPercentage, 0, stateVaccinated, true);
+
+            if (state & stateImmune)
+                addRoll(transition, 100, rules.loseImmunityPercentage, 0, 0, stateImmune, 0, true);
+        }
+    }
+}
+
+#endif
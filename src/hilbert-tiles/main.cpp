@@ -0,0 +1,719 @@
+#include <allegro5/allegro.h>
+#include <allegro5/allegro_primitives.h>
+#include <mpich/mpi.h>
+#include <cmath> // sqrt
+#include "../headers/Settings.hpp"
+#include "../headers/Person.hpp"
+#include "../headers/PopulationLoader.hpp"
+#include "../headers/Outbreak.hpp"
+#include "../headers/Ensemble.hpp"
+#include "../headers/Stencil.hpp"
+#include "../headers/Grid.hpp"
+#include "../headers/GeometricSkip.hpp"
+#include "../headers/Hilbert.hpp"
+
+// The grid is cut in tiles of about tileSize * tileSize people, many more than ranks, and every rank
+// owns a run of consecutive tiles along a Hilbert curve (see Hilbert.hpp). Every tile has its own
+// halo, filled from the 8 tiles around it: with a copy when this rank owns the neighbour too and with
+// a message otherwise, following an exchange plan built from the tile adjacency every time the owners
+// change. With rebalanceInterval set the curve is cut again by the measured update time of each tile
+// and the tiles that change owner are moved whole.
+
+#define debug
+#define usingGraphics
+
+// memory order of the tiles and of the gathered frame, RowMajor or ColumnMajor
+#define layout ColumnMajor
+
+Settings settings;
+
+#define root 0
+
+int rows;
+int cols;
+
+int square;
+
+int numberOfGenerations;
+
+int millisecondsToWaitForEachGeneration;
+
+Rules rules;
+
+// spontaneous vaccinations, drawn as gaps between hits instead of one roll per person
+GeometricSkip vaccinations;
+
+
+int rank, size;
+
+// replica run by this rank, a single one spanning every rank unless ensembleGroupSize is set
+Ensemble ensemble;
+EnsembleStatistics * statistics = NULL;
+int worldRank;
+MPI_Comm comm;
+
+struct Tile
+{
+    // people of the whole matrix in this tile
+    int firstRow;
+    int firstCol;
+    int rows;
+    int cols;
+
+    // the 8 tiles around this one, in the order of haloOffsets
+    int neighbours[8];
+
+    // owned people in rows 1..rows and columns 1..cols plus the halo, allocated only by the owner
+    Grid<layout> grid;
+    Person * read;
+    Person * write;
+
+    MPI_Datatype column_t;
+    MPI_Datatype row_t;
+    MPI_Datatype subMatrixType;
+
+    // time spent updating it since the last rebalance, kept by the owner
+    double seconds;
+};
+
+// tiles are tileSize people wide and tall, the last row and column of tiles take what is left over
+int tileSize;
+int tileRowCount;
+int tileColCount;
+
+// tile (i, j) is tiles[i * tileColCount + j]
+std::vector<Tile> tiles;
+
+// tiles in the order of the curve, the rank owning each of them and the ones owned here
+std::vector<int> curve;
+std::vector<int> owners;
+std::vector<int> ownedTiles;
+
+int rebalanceInterval;
+
+// the halo of a tile on side d, filled by another rank or by this one
+struct HaloMessage
+{
+    int tile;
+    int d;
+    int peer;
+};
+
+std::vector<HaloMessage> haloReceives;
+std::vector<HaloMessage> haloSends;
+std::vector<HaloMessage> haloCopies;
+std::vector<MPI_Request> haloRequests;
+
+inline void initialize();
+
+#ifdef usingGraphics
+    ALLEGRO_DISPLAY * display = NULL;
+
+    // colors from settings, set by loadSettings()
+    ALLEGRO_COLOR defaultPersonColor;
+    ALLEGRO_COLOR infectedColor;
+    ALLEGRO_COLOR imuneColor;
+    ALLEGRO_COLOR deadColor;
+    ALLEGRO_COLOR vaccinatedColor;
+    ALLEGRO_COLOR incubationColor;
+#endif //usignGraphics
+
+MPI_Datatype corner_t;
+
+// row and column offset of each neighbour, opposite neighbours are 7 - d apart
+const int haloOffsets[8][2] = {{-1, -1}, {-1, 0}, {-1, 1}, {0, -1}, {0, 1}, {1, -1}, {1, 0}, {1, 1}};
+
+inline void loadSettings(int argc, char * argv[]);
+inline void decompose();
+inline void allocateTile(Tile & tile);
+inline void releaseTile(Tile & tile);
+inline void planHalos();
+inline void rebalance();
+inline void sendBorders();
+inline void receiveBorders();
+inline void update();
+inline void updateBorders();
+inline void updateRegion(Tile & tile, int firstRow, int lastRow, int firstCol, int lastCol);
+inline void draw(Person * people, const Block & block);
+inline void swap();
+inline void countGeneration(int generation);
+inline void finalize();
+
+
+inline size_t m(const Tile & tile, int i, int j) {return tile.grid.index(i, j);}
+
+
+
+
+
+
+int main(int argc, char * argv[])
+{
+    double elapsedTime = 0;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &worldRank);
+
+    loadSettings(argc, argv);
+
+    // from here on every rank only talks to the ranks of its own replica
+    decompose();
+
+    if (rank == root) elapsedTime = MPI_Wtime();
+
+    #ifdef usingGraphics
+
+        // only the first replica is drawn
+        bool drawing = ensemble.group == 0;
+
+        // root draws the tiles one at a time, it never holds more than one of them
+        std::vector<Person> frame;
+
+        if (rank == root && drawing)
+        {
+            al_init();
+            display = al_create_display(cols * square, rows * square);
+            al_init_primitives_addon();
+            al_set_app_name("Covid19 Simulation");
+        }
+
+    #endif // usingGraphics
+
+    srand(settings.getSeed() + worldRank);
+    initialize();
+
+    if (settings.getEnsembleGroupSize() > 0)
+    {
+        statistics = new EnsembleStatistics(numberOfGenerations);
+        countGeneration(0);
+    }
+
+
+    for (int i = 1; i <= numberOfGenerations; ++i)
+    {
+        #ifdef debug
+            if (rank == root)
+                printf("Generation %d\n", i);
+        #endif // debug
+
+        #ifdef usingGraphics
+        if (drawing)
+        {
+            std::vector<MPI_Request> requests(ownedTiles.size());
+
+            // in the order of the tiles, so the root can receive them in the same order from each rank
+            for (size_t k = 0; k < ownedTiles.size(); ++k)
+                MPI_Isend(tiles[ownedTiles[k]].read, 1, tiles[ownedTiles[k]].subMatrixType, root, 500, comm, &requests[k]);
+
+            if (rank == root)
+            {
+                al_clear_to_color(defaultPersonColor);
+
+                for (size_t t = 0; t < tiles.size(); ++t)
+                {
+                    Tile & tile = tiles[t];
+
+                    frame.resize((size_t) tile.rows * tile.cols);
+                    MPI_Recv(frame.data(), tile.rows * tile.cols, personType(), owners[t], 500, comm, MPI_STATUS_IGNORE);
+
+                    draw(frame.data(), {tile.firstRow, tile.firstCol, tile.rows, tile.cols});
+                }
+
+                al_flip_display();
+            }
+
+            MPI_Waitall(requests.size(), requests.data(), MPI_STATUSES_IGNORE);
+        }
+        #endif // usingGraphics
+
+        sendBorders();
+        update();
+        receiveBorders();
+        updateBorders();
+
+        swap();
+
+        if (statistics) countGeneration(i);
+
+        if (rebalanceInterval > 0 && i % rebalanceInterval == 0 && i < numberOfGenerations) rebalance();
+
+        // no barrier, the halos keep every rank within a generation of its neighbours
+        sleep(millisecondsToWaitForEachGeneration);
+    }
+
+    MPI_Barrier(comm);
+
+    if (rank == root)
+    {
+        elapsedTime = MPI_Wtime() - elapsedTime;
+        printf("Elapsed time: %f\n", elapsedTime);
+    }
+
+    if (statistics)
+    {
+        statistics->write(ensemble, settings.getEnsembleOutput());
+        delete statistics;
+    }
+
+    #ifdef usingGraphics
+
+    if (rank == root && drawing) al_destroy_display(display);
+
+    #endif // usingGraphics
+
+    finalize();
+
+
+    return 0;
+}
+
+inline void loadSettings(int argc, char * argv[])
+{
+    // root parses the config file, every other rank gets it from a broadcast
+    settings = Settings::load(argc, argv, MPI_COMM_WORLD);
+
+    // the swept parameter of this replica has to be in place before the globals are read
+    ensemble = splitEnsemble(settings, MPI_COMM_WORLD);
+
+    rows = settings.getRows();
+    cols = settings.getCols();
+
+    square = settings.getSquareSize();
+
+    numberOfGenerations = settings.getNumberOfGenerations();
+
+    rules = rulesFrom(settings);
+    vaccinations = spontaneousVaccinations(rules);
+
+    tileSize = settings.getTileSize();
+    rebalanceInterval = settings.getRebalanceInterval();
+
+    millisecondsToWaitForEachGeneration = settings.getMillisecodsToWaitForEachGeneration();
+
+    #ifdef usingGraphics
+        defaultPersonColor = al_map_rgb(settings.getDefaultPersonColor().r, settings.getDefaultPersonColor().g, settings.getDefaultPersonColor().b);
+        infectedColor = al_map_rgb(settings.getInfectedColor().r, settings.getInfectedColor().g, settings.getInfectedColor().b);
+        imuneColor = al_map_rgb(settings.getImmuneColor().r, settings.getImmuneColor().g, settings.getImmuneColor().b);
+        deadColor = al_map_rgb(settings.getDeadColor().r, settings.getDeadColor().g, settings.getDeadColor().b);
+        vaccinatedColor = al_map_rgb(settings.getVaccinatedColor().r, settings.getVaccinatedColor().g, settings.getVaccinatedColor().b);
+        incubationColor = al_map_rgb(settings.getIncubationColor().r, settings.getIncubationColor().g, settings.getIncubationColor().b);
+    #endif //usingGraphics
+}
+
+// cuts the matrix in tiles, links every tile to the ones around it and hands out the first runs of the curve
+inline void decompose()
+{
+    MPI_Comm_dup(ensemble.comm, &comm);
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    // about 16 tiles per rank unless tileSize says otherwise
+    if (tileSize == 0) tileSize = std::max(2, (int) sqrt((double) rows * cols / (16 * size)));
+
+    // both checks fail on every rank of the replica, the job stops instead of leaving them in a collective
+    if (tileSize < 2 || tileSize > rows || tileSize > cols)
+    {
+        if (rank == root) fprintf(stderr, "ERROR: tileSize must be between 2 and the rows and columns of the grid\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    tileRowCount = rows / tileSize;
+    tileColCount = cols / tileSize;
+
+    if (tileRowCount * tileColCount < size)
+    {
+        if (rank == root) fprintf(stderr, "ERROR: every rank needs at least one tile, lower tileSize\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    tiles.resize(tileRowCount * tileColCount);
+
+    for (int i = 0; i < tileRowCount; ++i)
+    {
+        for (int j = 0; j < tileColCount; ++j)
+        {
+            Tile & tile = tiles[i * tileColCount + j];
+
+            tile.firstRow = i * tileSize;
+            tile.firstCol = j * tileSize;
+            tile.rows = i == tileRowCount - 1 ? rows - tile.firstRow : tileSize;
+            tile.cols = j == tileColCount - 1 ? cols - tile.firstCol : tileSize;
+
+            // the tiles wrap around like the matrix
+            for (int d = 0; d < 8; ++d)
+            {
+                int ni = (i + haloOffsets[d][0] + tileRowCount) % tileRowCount;
+                int nj = (j + haloOffsets[d][1] + tileColCount) % tileColCount;
+                tile.neighbours[d] = ni * tileColCount + nj;
+            }
+
+            tile.grid = Grid<layout>(tile.rows + 2, tile.cols + 2);
+            tile.read = tile.write = NULL;
+            tile.seconds = 0;
+
+            // the types follow the layout, a column is contiguous in ColumnMajor and a row in RowMajor
+            tile.grid.columnType(tile.rows, personType(), &tile.column_t);
+            tile.grid.rowType(tile.cols, personType(), &tile.row_t);
+            tile.grid.blockType(1, 1, tile.rows, tile.cols, personType(), &tile.subMatrixType);
+        }
+    }
+
+    MPI_Type_contiguous(1, personType(), &corner_t);
+    MPI_Type_commit(&corner_t);
+
+    // until there is something to measure a tile costs as much as it has people
+    std::vector<double> costs(tiles.size());
+    for (size_t t = 0; t < tiles.size(); ++t) costs[t] = (double) tiles[t].rows * tiles[t].cols;
+
+    curve = hilbertOrder(tileRowCount, tileColCount);
+    owners = curveOwners(curve, costs, size);
+
+    for (size_t t = 0; t < tiles.size(); ++t)
+    {
+        if (owners[t] == rank)
+        {
+            allocateTile(tiles[t]);
+            ownedTiles.push_back(t);
+        }
+    }
+
+    planHalos();
+}
+
+inline void allocateTile(Tile & tile)
+{
+    // value initialized, every flag starts cleared
+    tile.read = new Person[tile.grid.size()]();
+    tile.write = new Person[tile.grid.size()]();
+    tile.seconds = 0;
+}
+
+inline void releaseTile(Tile & tile)
+{
+    delete [] tile.read;
+    delete [] tile.write;
+    tile.read = tile.write = NULL;
+}
+
+// Lists which halos of the owned tiles come from other ranks and which are copied here, and which
+// owned borders other ranks wait for. Both ends of a message list it in the order of the receiving
+// tile and side, so messages between two ranks match in the order they are posted.
+inline void planHalos()
+{
+    haloReceives.clear();
+    haloSends.clear();
+    haloCopies.clear();
+
+    for (size_t t = 0; t < tiles.size(); ++t)
+    {
+        for (int d = 0; d < 8; ++d)
+        {
+            int from = owners[tiles[t].neighbours[d]];
+
+            if (owners[t] == rank && from == rank) haloCopies.push_back({(int) t, d, rank});
+            else if (owners[t] == rank) haloReceives.push_back({(int) t, d, from});
+            else if (from == rank) haloSends.push_back({(int) t, d, owners[t]});
+        }
+    }
+
+    haloRequests.resize(haloReceives.size() + haloSends.size());
+}
+
+// moves the ends of the runs towards the ranks whose tiles updated faster since the last call
+inline void rebalance()
+{
+    std::vector<double> costs(tiles.size(), 0);
+
+    for (int t : ownedTiles)
+    {
+        costs[t] = tiles[t].seconds;
+        tiles[t].seconds = 0;
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, costs.data(), costs.size(), MPI_DOUBLE, MPI_SUM, comm);
+
+    std::vector<int> newOwners = curveOwners(curve, costs, size);
+
+    if (newOwners == owners) return;
+
+    // the tiles that change owner move whole, in the order of the tiles
+    std::vector<MPI_Request> requests;
+
+    for (size_t t = 0; t < tiles.size(); ++t)
+    {
+        if (owners[t] == newOwners[t]) continue;
+
+        if (owners[t] == rank)
+        {
+            requests.emplace_back();
+            MPI_Isend(tiles[t].read, 1, tiles[t].subMatrixType, newOwners[t], 0, comm, &requests.back());
+        }
+        else if (newOwners[t] == rank)
+        {
+            allocateTile(tiles[t]);
+
+            requests.emplace_back();
+            MPI_Irecv(tiles[t].read, 1, tiles[t].subMatrixType, owners[t], 0, comm, &requests.back());
+        }
+    }
+
+    MPI_Waitall(requests.size(), requests.data(), MPI_STATUSES_IGNORE);
+
+    ownedTiles.clear();
+
+    for (size_t t = 0; t < tiles.size(); ++t)
+    {
+        if (owners[t] == rank && newOwners[t] != rank) releaseTile(tiles[t]);
+        if (newOwners[t] == rank) ownedTiles.push_back(t);
+    }
+
+    owners = newOwners;
+
+    planHalos();
+}
+
+inline void initialize()
+{
+    if (!settings.getPopulationFile().empty())
+    {
+        // every rank reads all of its tiles at once
+        std::vector<Block> owned;
+        for (int t : ownedTiles) owned.push_back({tiles[t].firstRow, tiles[t].firstCol, tiles[t].rows, tiles[t].cols});
+
+        std::vector<std::vector<uint16_t>> blocks;
+        readPopulationBlocks(settings.getPopulationFile(), comm, rows, cols, owned, blocks);
+
+        for (size_t k = 0; k < ownedTiles.size(); ++k)
+        {
+            Tile & tile = tiles[ownedTiles[k]];
+
+            for (int i = 0; i < tile.rows; ++i)
+                for (int j = 0; j < tile.cols; ++j)
+                    tile.read[m(tile, i + 1, j + 1)] = decodePopulationCell(blocks[k][i * tile.cols + j]);
+        }
+
+        return;
+    }
+
+    uint64_t seed = populationSeed(settings.getSeed(), ensemble.group);
+
+    for (int t : ownedTiles)
+    {
+        Tile & tile = tiles[t];
+
+        tile.grid.forEach(1, tile.rows + 1, 1, tile.cols + 1, [&tile, seed](int i, int j)
+        {
+            tile.read[m(tile, i, j)] = generatedPerson(seed, tile.firstRow + i - 1, tile.firstCol + j - 1);
+        });
+    }
+
+    // the last row and column of tiles take what is left over
+    auto tileOf = [](int row, int col)
+    {
+        return std::min(row / tileSize, tileRowCount - 1) * tileColCount + std::min(col / tileSize, tileColCount - 1);
+    };
+
+    // every seed goes to the rank owning its tile
+    std::vector<OutbreakSeed> seeds = scatterOutbreak(settings, rows, cols, comm, [&tileOf](int row, int col)
+    {
+        return owners[tileOf(row, col)];
+    });
+
+    for (OutbreakSeed seed : seeds)
+    {
+        Tile & tile = tiles[tileOf(seed.row, seed.col)];
+        tile.read[m(tile, seed.row - tile.firstRow + 1, seed.col - tile.firstCol + 1)].values.isInfected = 1;
+    }
+}
+
+inline void finalize()
+{
+    for (Tile & tile : tiles)
+    {
+        if (tile.read) releaseTile(tile);
+
+        MPI_Type_free(&tile.column_t);
+        MPI_Type_free(&tile.row_t);
+        MPI_Type_free(&tile.subMatrixType);
+    }
+
+    MPI_Type_free(&corner_t);
+
+    MPI_Comm_free(&comm);
+    freeEnsemble(ensemble);
+
+    MPI_Finalize();
+}
+
+// people that don't need the halo
+inline void update()
+{
+    for (int t : ownedTiles)
+    {
+        Tile & tile = tiles[t];
+
+        double start = MPI_Wtime();
+        updateRegion(tile, 2, tile.rows, 2, tile.cols);
+        tile.seconds += MPI_Wtime() - start;
+    }
+}
+
+// the ring of owned people next to the halo
+inline void updateBorders()
+{
+    for (int t : ownedTiles)
+    {
+        Tile & tile = tiles[t];
+
+        double start = MPI_Wtime();
+        updateRegion(tile, 1, 2, 1, tile.cols + 1);
+        updateRegion(tile, tile.rows, tile.rows + 1, 1, tile.cols + 1);
+        updateRegion(tile, 2, tile.rows, 1, 2);
+        updateRegion(tile, 2, tile.rows, tile.cols, tile.cols + 1);
+        tile.seconds += MPI_Wtime() - start;
+    }
+}
+
+// rows [firstRow, lastRow) of columns [firstCol, lastCol) of a tile, traversed in the order of the layout
+inline void updateRegion(Tile & tile, int firstRow, int lastRow, int firstCol, int lastCol)
+{
+    updateStencil(tile.grid, firstRow, lastRow, firstCol, lastCol,
+        [&tile](int i, int j) -> const Person & {return tile.read[m(tile, i, j)];},
+        [&tile](int i, int j) -> Person & {return tile.write[m(tile, i, j)];},
+        cascade(rules, vaccinations));
+}
+
+// first owned row or column next to the neighbour at offset, and the halo row or column it fills there
+inline int borderIndex(int offset, int inner) {return offset > 0 ? inner : 1;}
+inline int haloIndex(int offset, int inner) {return offset < 0 ? 0 : offset > 0 ? inner + 1 : 1;}
+
+inline MPI_Datatype haloType(const Tile & tile, int d)
+{
+    if (haloOffsets[d][0] == 0) return tile.column_t;
+    if (haloOffsets[d][1] == 0) return tile.row_t;
+    return corner_t;
+}
+
+// starts the exchange of the borders between ranks, tags are the side of the receiving tile, then fills
+// the halos that come from tiles owned here
+inline void sendBorders()
+{
+    size_t r = 0;
+
+    for (const HaloMessage & halo : haloReceives)
+    {
+        Tile & tile = tiles[halo.tile];
+
+        int i = haloIndex(haloOffsets[halo.d][0], tile.rows);
+        int j = haloIndex(haloOffsets[halo.d][1], tile.cols);
+
+        MPI_Irecv(&tile.read[m(tile, i, j)], 1, haloType(tile, halo.d), halo.peer, halo.d, comm, &haloRequests[r++]);
+    }
+
+    // the border of the neighbour faces the receiving tile, on the opposite side
+    for (const HaloMessage & halo : haloSends)
+    {
+        Tile & from = tiles[tiles[halo.tile].neighbours[halo.d]];
+
+        int i = borderIndex(haloOffsets[7 - halo.d][0], from.rows);
+        int j = borderIndex(haloOffsets[7 - halo.d][1], from.cols);
+
+        MPI_Isend(&from.read[m(from, i, j)], 1, haloType(from, 7 - halo.d), halo.peer, halo.d, comm, &haloRequests[r++]);
+    }
+
+    for (const HaloMessage & halo : haloCopies)
+    {
+        Tile & tile = tiles[halo.tile];
+        const Tile & from = tiles[tile.neighbours[halo.d]];
+
+        int i = haloIndex(haloOffsets[halo.d][0], tile.rows);
+        int j = haloIndex(haloOffsets[halo.d][1], tile.cols);
+        int fromI = borderIndex(haloOffsets[7 - halo.d][0], from.rows);
+        int fromJ = borderIndex(haloOffsets[7 - halo.d][1], from.cols);
+
+        // a whole side next to a tile in the same row or column of tiles, a single person at the corners
+        int height = haloOffsets[halo.d][0] == 0 ? tile.rows : 1;
+        int width = haloOffsets[halo.d][1] == 0 ? tile.cols : 1;
+
+        tile.grid.forEach(0, height, 0, width, [&](int k, int l)
+        {
+            tile.read[m(tile, i + k, j + l)] = from.read[m(from, fromI + k, fromJ + l)];
+        });
+    }
+}
+
+inline void receiveBorders()
+{
+    MPI_Waitall(haloRequests.size(), haloRequests.data(), MPI_STATUSES_IGNORE);
+}
+
+#ifdef usingGraphics
+// draws the people of block, received from its owner in a grid of their own
+inline void draw(Person * people, const Block & block)
+{
+    Grid<layout> frame(block.rows, block.cols);
+
+    for (int j = 0; j < block.cols; ++j)
+    {
+        for (int i = 0; i < block.rows; ++i)
+        {
+            Person person = people[frame.index(i,j)];
+
+            int x = (block.firstCol + j) * square;
+            int y = (block.firstRow + i) * square;
+
+            if (person.values.isInfected && person.values.daysOfIncubation < 3)
+            {
+                al_draw_filled_rectangle(x, y, x + square, y + square, incubationColor);
+            }
+            else if (person.values.isInfected)
+            {
+                al_draw_filled_rectangle(x, y, x + square, y + square, infectedColor);
+            }
+            else if (person.values.isImmune)
+            {
+                al_draw_filled_rectangle(x, y, x + square, y + square, imuneColor);
+            }
+            else if (person.values.isDead)
+            {
+                al_draw_filled_rectangle(x, y, x + square, y + square, deadColor);
+            }
+            else if (person.values.isVaccinated)
+            {
+                al_draw_filled_rectangle(x, y, x + square, y + square, vaccinatedColor);
+            }
+            else 
+            {
+                al_draw_filled_rectangle(x, y, x + square, y + square, defaultPersonColor);
+            }
+
+            // add black layer that scales with person age
+            al_draw_filled_rectangle(x, y, x + square, y + square, al_map_rgba(0, 0, 0, person.values.age));
+        }
+    }
+}
+#endif //usingGraphics
+
+inline void countGeneration(int generation)
+{
+    for (int t : ownedTiles)
+    {
+        Tile & tile = tiles[t];
+
+        tile.grid.forEach(1, tile.rows + 1, 1, tile.cols + 1, [&tile, generation](int i, int j)
+        {
+            statistics->count(generation, tile.read[m(tile, i, j)]);
+        });
+    }
+}
+
+inline void swap()
+{
+    for (int t : ownedTiles)
+    {
+        Person * tmp;
+        tmp = tiles[t].read;
+        tiles[t].read = tiles[t].write;
+        tiles[t].write = tmp;
+    }
+}
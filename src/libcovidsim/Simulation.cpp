@@ -0,0 +1,533 @@
+#include <algorithm> // sort, unique, upper_bound, fill
+
+#include "Simulation.hpp"
+#include "../headers/PopulationLoader.hpp"
+#include "../headers/Outbreak.hpp"
+#include "../headers/Stencil.hpp"
+#include "../headers/Balance.hpp"
+
+// how the halos travel, from the haloExchange setting:
+//  messages: Isend / Irecv with every neighbour
+//  shared: both buffers of people sit in MPI shared memory windows and the halos that come from ranks on
+//          the same node are copied straight out of their memory, the other ones still travel in messages
+//  put: both buffers of people are exposed in MPI windows and every rank puts its border in the halos of
+//       its neighbours, in a post-start-complete-wait epoch with just the neighbours
+#define messageHalos 0
+#define sharedHalos 1
+#define putHalos 2
+
+// tells the rolls apart from the population drawn from the same seed and replica
+#define rollStream 0x726f6c6c00000000ull
+
+// row and column offset of each neighbour, opposite neighbours are 7 - d apart
+static const int haloOffsets[8][2] = {{-1, -1}, {-1, 0}, {-1, 1}, {0, -1}, {0, 1}, {1, -1}, {1, 0}, {1, 1}};
+
+// first owned row or column next to the neighbour at offset, and the halo row or column it fills there
+static inline int borderIndex(int offset, int inner) {return offset > 0 ? inner : 1;}
+static inline int haloIndex(int offset, int inner) {return offset < 0 ? 0 : offset > 0 ? inner + 1 : 1;}
+
+
+Simulation::Simulation(const Settings & settings, MPI_Comm parent, int replica) : settings(settings), generation(0), random(0, 0, 0, 0), updateSeconds(0)
+{
+    rows = settings.getRows();
+    cols = settings.getCols();
+
+    rules = rulesFrom(settings);
+    vaccinations = spontaneousVaccinations(rules);
+
+    rebalanceInterval = settings.getRebalanceInterval();
+    haloExchange = settings.getHaloExchange() == "shared" ? sharedHalos : settings.getHaloExchange() == "put" ? putHalos : messageHalos;
+
+    peopleWindows[0] = peopleWindows[1] = MPI_WIN_NULL;
+    readWindow = 0;
+
+    decompose(parent);
+
+    // every rank of every replica rolls its own dice, from a key of their own and not the one of the population
+    rollSeed = counterHash(populationSeed(settings.getSeed(), replica) ^ rollStream);
+
+    initialize(replica);
+}
+
+Simulation::~Simulation()
+{
+    freeTypes();
+
+    freePeople(readMatrix, &peopleWindows[readWindow]);
+    freePeople(writeMatrix, &peopleWindows[1 - readWindow]);
+
+    if (haloExchange == sharedHalos) MPI_Comm_free(&nodeComm);
+    if (haloExchange == putHalos) MPI_Group_free(&neighbourGroup);
+
+    MPI_Comm_free(&comm);
+}
+
+void Simulation::step(int generations)
+{
+    for (int g = 0; g < generations; ++g)
+    {
+        // the blocks move between two steps, so the views of a generation always match its blocks
+        if (rebalanceInterval > 0 && generation > 0 && generation % rebalanceInterval == 0) rebalance();
+
+        random = CounterRandom(rollSeed, generation, rank, 0);
+
+        sendBorders();
+
+        double start = MPI_Wtime();
+        update();
+        updateSeconds += MPI_Wtime() - start;
+
+        receiveBorders();
+
+        start = MPI_Wtime();
+        updateBorders();
+        updateSeconds += MPI_Wtime() - start;
+
+        swap();
+
+        // no barrier, the halos keep every rank within a generation of its neighbours
+        ++generation;
+    }
+}
+
+SimulationCounts Simulation::countLocal() const
+{
+    SimulationCounts counts = {0, 0, 0, 0};
+
+    local.forEach(1, block.rows + 1, 1, block.cols + 1, [this, &counts](int i, int j)
+    {
+        const Person & person = readMatrix[m(i,j)];
+
+        counts.infected += person.values.isInfected;
+        counts.immune += person.values.isImmune;
+        counts.dead += person.values.isDead;
+        counts.vaccinated += person.values.isVaccinated;
+    });
+
+    return counts;
+}
+
+SimulationCounts Simulation::count() const
+{
+    SimulationCounts counts = countLocal();
+    MPI_Allreduce(MPI_IN_PLACE, &counts, 4, MPI_LONG, MPI_SUM, comm);
+
+    return counts;
+}
+
+// lays the ranks of parent out in a periodic grid, sizes the local blocks and builds the halo types;
+// the blocks start as equal as possible, rows and columns of ranks share their heights and widths
+void Simulation::decompose(MPI_Comm parent)
+{
+    int parentSize;
+    MPI_Comm_size(parent, &parentSize);
+
+    dims[0] = dims[1] = 0;
+    MPI_Dims_create(parentSize, 2, dims);
+
+    // dims come largest first, the longer side of a rectangular grid gets more ranks
+    if (cols > rows) std::swap(dims[0], dims[1]);
+
+    int periods[2] = {1, 1};
+    MPI_Cart_create(parent, 2, dims, periods, 0, &comm);
+
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    MPI_Cart_coords(comm, rank, 2, coords);
+
+    if (rows < 2 * dims[0] || cols < 2 * dims[1])
+        throw std::invalid_argument("ERROR: the grid must split in blocks of at least 2x2 people");
+
+    for (int d = 0; d < 8; ++d)
+    {
+        int neighbourCoords[2] = {coords[0] + haloOffsets[d][0], coords[1] + haloOffsets[d][1]};
+        MPI_Cart_rank(comm, neighbourCoords, &neighbours[d]);
+        nodeNeighbours[d] = MPI_UNDEFINED;
+    }
+
+    if (haloExchange == sharedHalos)
+    {
+        // the ranks that can map each other's memory
+        MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &nodeComm);
+
+        MPI_Group group, nodeGroup;
+        MPI_Comm_group(comm, &group);
+        MPI_Comm_group(nodeComm, &nodeGroup);
+        MPI_Group_translate_ranks(group, 8, neighbours, nodeGroup, nodeNeighbours);
+        MPI_Group_free(&group);
+        MPI_Group_free(&nodeGroup);
+    }
+
+    if (haloExchange == putHalos)
+    {
+        // a rank can be the neighbour on several sides, or its own one, but only once in the group
+        std::vector<int> members(neighbours, neighbours + 8);
+        std::sort(members.begin(), members.end());
+        members.erase(std::unique(members.begin(), members.end()), members.end());
+
+        MPI_Group group;
+        MPI_Comm_group(comm, &group);
+        MPI_Group_incl(group, members.size(), members.data(), &neighbourGroup);
+        MPI_Group_free(&group);
+    }
+
+    split(evenSizes(rows, dims[0]), evenSizes(cols, dims[1]));
+    createTypes();
+}
+
+// people of the whole matrix owned by rank r when the rows of ranks are heights tall and the columns widths wide
+Block Simulation::blockOf(int r, const std::vector<int> & heights, const std::vector<int> & widths) const
+{
+    int blockCoords[2];
+    MPI_Cart_coords(comm, r, 2, blockCoords);
+
+    return {offsetsOf(heights)[blockCoords[0]], offsetsOf(widths)[blockCoords[1]], heights[blockCoords[0]], widths[blockCoords[1]]};
+}
+
+// allocates the block of this rank
+void Simulation::split(const std::vector<int> & heights, const std::vector<int> & widths)
+{
+    blockRows = heights;
+    blockCols = widths;
+
+    block = blockOf(rank, blockRows, blockCols);
+
+    local = Grid<SimulationLayout>(block.rows + 2, block.cols + 2);
+
+    // value initialized, every flag starts cleared
+    readMatrix = allocatePeople(local.size(), &peopleWindows[0]);
+    writeMatrix = allocatePeople(local.size(), &peopleWindows[1]);
+    readWindow = 0;
+
+    findNeighbours();
+}
+
+// count cleared people, in a window when the halos are shared (collective on nodeComm) or put (collective on comm)
+Person * Simulation::allocatePeople(size_t count, MPI_Win * window)
+{
+    if (haloExchange == messageHalos)
+    {
+        *window = MPI_WIN_NULL;
+        return new Person[count]();
+    }
+
+    Person * people;
+
+    if (haloExchange == sharedHalos)
+        MPI_Win_allocate_shared(count * sizeof(Person), sizeof(Person), MPI_INFO_NULL, nodeComm, &people, window);
+    else
+        MPI_Win_allocate(count * sizeof(Person), sizeof(Person), MPI_INFO_NULL, comm, &people, window);
+
+    std::fill(people, people + count, Person());
+
+    // shared windows stay in a single passive epoch for their whole life, MPI_Win_sync orders the accesses
+    if (haloExchange == sharedHalos) MPI_Win_lock_all(MPI_MODE_NOCHECK, *window);
+
+    return people;
+}
+
+void Simulation::freePeople(Person * people, MPI_Win * window)
+{
+    if (*window == MPI_WIN_NULL)
+    {
+        delete [] people;
+        return;
+    }
+
+    if (haloExchange == sharedHalos) MPI_Win_unlock_all(*window);
+    MPI_Win_free(window);
+}
+
+// the shape of the local block of every neighbour, to find its border or its halo in its buffers, and
+// both buffers of the neighbours on this node
+void Simulation::findNeighbours()
+{
+    for (int d = 0; d < 8; ++d)
+    {
+        Block neighbour = blockOf(neighbours[d], blockRows, blockCols);
+        neighbourGrids[d] = Grid<SimulationLayout>(neighbour.rows + 2, neighbour.cols + 2);
+
+        neighbourPeople[d][0] = neighbourPeople[d][1] = NULL;
+
+        if (nodeNeighbours[d] == MPI_UNDEFINED) continue;
+
+        for (int b = 0; b < 2; ++b)
+        {
+            MPI_Aint bytes;
+            int unit;
+            MPI_Win_shared_query(peopleWindows[b], nodeNeighbours[d], &bytes, &unit, &neighbourPeople[d][b]);
+        }
+    }
+}
+
+void Simulation::createTypes()
+{
+    // the types follow the layout, a column is contiguous in ColumnMajor and a row in RowMajor
+    local.columnType(block.rows, personType(), &column_t);
+    local.rowType(block.cols, personType(), &row_t);
+    MPI_Type_contiguous(1, personType(), &corner_t);
+    MPI_Type_commit(&corner_t);
+
+    // owned people, used from the start of the local block
+    local.blockType(1, 1, block.rows, block.cols, personType(), &subMatrixType);
+
+    // the halo facing this rank in the block of each neighbour, on its opposite side
+    if (haloExchange == putHalos)
+    {
+        for (int d = 0; d < 8; ++d)
+        {
+            const Grid<SimulationLayout> & grid = neighbourGrids[d];
+
+            if (haloOffsets[d][0] == 0) grid.columnType(block.rows, personType(), &neighbourHaloTypes[d]);
+            else if (haloOffsets[d][1] == 0) grid.rowType(block.cols, personType(), &neighbourHaloTypes[d]);
+            else MPI_Type_dup(corner_t, &neighbourHaloTypes[d]);
+
+            neighbourHaloDisplacements[d] = grid.index(haloIndex(haloOffsets[7 - d][0], grid.getRows() - 2),
+                                                       haloIndex(haloOffsets[7 - d][1], grid.getCols() - 2));
+        }
+    }
+}
+
+void Simulation::freeTypes()
+{
+    MPI_Type_free(&column_t);
+    MPI_Type_free(&row_t);
+    MPI_Type_free(&corner_t);
+    MPI_Type_free(&subMatrixType);
+
+    if (haloExchange == putHalos)
+        for (int d = 0; d < 8; ++d) MPI_Type_free(&neighbourHaloTypes[d]);
+}
+
+// moves the block boundaries towards the rows and columns of ranks that updated their people faster since
+// the last call, a row or column of ranks is as fast as its slowest rank
+void Simulation::rebalance()
+{
+    std::vector<double> seconds(size);
+    MPI_Allgather(&updateSeconds, 1, MPI_DOUBLE, seconds.data(), 1, MPI_DOUBLE, comm);
+    updateSeconds = 0;
+
+    std::vector<double> rowSeconds(dims[0], 0), colSeconds(dims[1], 0);
+
+    for (int r = 0; r < size; ++r)
+    {
+        int blockCoords[2];
+        MPI_Cart_coords(comm, r, 2, blockCoords);
+
+        rowSeconds[blockCoords[0]] = std::max(rowSeconds[blockCoords[0]], seconds[r]);
+        colSeconds[blockCoords[1]] = std::max(colSeconds[blockCoords[1]], seconds[r]);
+    }
+
+    std::vector<int> heights = balancedSizes(blockRows, rowSeconds, 2);
+    std::vector<int> widths = balancedSizes(blockCols, colSeconds, 2);
+
+    if (heights == blockRows && widths == blockCols) return;
+
+    std::vector<Block> before(size), after(size);
+
+    for (int r = 0; r < size; ++r)
+    {
+        before[r] = blockOf(r, blockRows, blockCols);
+        after[r] = blockOf(r, heights, widths);
+    }
+
+    Grid<SimulationLayout> oldLocal = local;
+    Person * oldMatrix = readMatrix;
+    Person * oldWriteMatrix = writeMatrix;
+    MPI_Win oldWindows[2] = {peopleWindows[readWindow], peopleWindows[1 - readWindow]};
+
+    freeTypes();
+    split(heights, widths);
+    createTypes();
+
+    // only the current generation moves, the halos come with the next exchange
+    redistribute(comm, before, after, 1, 1, oldLocal, oldMatrix, local, readMatrix, personType());
+
+    freePeople(oldMatrix, &oldWindows[0]);
+    freePeople(oldWriteMatrix, &oldWindows[1]);
+}
+
+void Simulation::initialize(int replica)
+{
+    if (!settings.getPopulationFile().empty())
+    {
+        // each rank reads only its own block
+        std::vector<uint16_t> people;
+        readPopulationBlock(settings.getPopulationFile(), comm, rows, cols,
+                            block.firstRow, block.firstCol, block.rows, block.cols, people);
+
+        for (int i = 0; i < block.rows; ++i)
+            for (int j = 0; j < block.cols; ++j)
+                readMatrix[m(i + 1, j + 1)] = decodePopulationCell(people[i * block.cols + j]);
+
+        return;
+    }
+
+    uint64_t seed = populationSeed(settings.getSeed(), replica);
+
+    local.forEach(1, block.rows + 1, 1, block.cols + 1, [this, seed](int i, int j)
+    {
+        readMatrix[m(i,j)] = generatedPerson(seed, block.firstRow + i - 1, block.firstCol + j - 1);
+    });
+
+    // every seed goes to the rank owning its row of ranks and column of ranks
+    std::vector<int> rowOffsets = offsetsOf(blockRows);
+    std::vector<int> colOffsets = offsetsOf(blockCols);
+
+    std::vector<OutbreakSeed> seeds = scatterOutbreak(settings, rows, cols, comm, [this, &rowOffsets, &colOffsets](int row, int col)
+    {
+        int owner;
+        int ownerCoords[2] = {(int) (std::upper_bound(rowOffsets.begin(), rowOffsets.end(), row) - rowOffsets.begin()) - 1,
+                              (int) (std::upper_bound(colOffsets.begin(), colOffsets.end(), col) - colOffsets.begin()) - 1};
+
+        MPI_Cart_rank(comm, ownerCoords, &owner);
+        return owner;
+    });
+
+    for (OutbreakSeed seed : seeds)
+        readMatrix[m(seed.row - block.firstRow + 1, seed.col - block.firstCol + 1)].values.isInfected = 1;
+}
+
+// people that don't need the halo
+void Simulation::update()
+{
+    updateRegion(2, block.rows, 2, block.cols);
+}
+
+// the ring of owned people next to the halo
+void Simulation::updateBorders()
+{
+    updateRegion(1, 2, 1, block.cols + 1);
+    updateRegion(block.rows, block.rows + 1, 1, block.cols + 1);
+    updateRegion(2, block.rows, 1, 2);
+    updateRegion(2, block.rows, block.cols, block.cols + 1);
+}
+
+// rows [firstRow, lastRow) of columns [firstCol, lastCol), traversed in the order of the layout
+void Simulation::updateRegion(int firstRow, int lastRow, int firstCol, int lastCol)
+{
+    updateStencil(local, firstRow, lastRow, firstCol, lastCol,
+        [this](int i, int j) -> const Person & {return readMatrix[m(i,j)];},
+        [this](int i, int j) -> Person & {return writeMatrix[m(i,j)];},
+        cascade(rules, vaccinations, random));
+}
+
+MPI_Datatype Simulation::haloType(int d) const
+{
+    if (haloOffsets[d][0] == 0) return column_t;
+    if (haloOffsets[d][1] == 0) return row_t;
+    return corner_t;
+}
+
+// starts the exchange of the owned border with the 8 neighbours, tags are the direction of the sender;
+// neighbours on the same node only need to know this generation is in place
+void Simulation::sendBorders()
+{
+    if (haloExchange == putHalos)
+    {
+        MPI_Win window = peopleWindows[readWindow];
+
+        // the halos of this rank are open to the neighbours, then the borders go in theirs
+        MPI_Win_post(neighbourGroup, 0, window);
+        MPI_Win_start(neighbourGroup, 0, window);
+
+        for (int d = 0; d < 8; ++d)
+        {
+            int i = borderIndex(haloOffsets[d][0], block.rows);
+            int j = borderIndex(haloOffsets[d][1], block.cols);
+
+            MPI_Put(&readMatrix[m(i,j)], 1, haloType(d), neighbours[d], neighbourHaloDisplacements[d], 1, neighbourHaloTypes[d], window);
+        }
+
+        return;
+    }
+
+    for (int d = 0; d < 8; ++d)
+    {
+        haloRequests[d] = haloRequests[8 + d] = MPI_REQUEST_NULL;
+
+        if (nodeNeighbours[d] != MPI_UNDEFINED) continue;
+
+        int i = haloIndex(haloOffsets[d][0], block.rows);
+        int j = haloIndex(haloOffsets[d][1], block.cols);
+
+        MPI_Irecv(&readMatrix[m(i,j)], 1, haloType(d), neighbours[d], 7 - d, comm, &haloRequests[d]);
+    }
+
+    for (int d = 0; d < 8; ++d)
+    {
+        if (nodeNeighbours[d] != MPI_UNDEFINED) continue;
+
+        int i = borderIndex(haloOffsets[d][0], block.rows);
+        int j = borderIndex(haloOffsets[d][1], block.cols);
+
+        MPI_Isend(&readMatrix[m(i,j)], 1, haloType(d), neighbours[d], d, comm, &haloRequests[8 + d]);
+    }
+
+    if (haloExchange == sharedHalos)
+    {
+        // Once a neighbour on the node is done with the previous generation its read buffer holds this
+        // one, and it's done copying out of the buffer this rank is about to write. Only the neighbours
+        // are waited for, tags above the halo ones are the direction of the sender.
+        MPI_Win_sync(peopleWindows[readWindow]);
+
+        for (int d = 0; d < 8; ++d)
+        {
+            readyRequests[d] = readyRequests[8 + d] = MPI_REQUEST_NULL;
+
+            if (nodeNeighbours[d] == MPI_UNDEFINED) continue;
+
+            MPI_Irecv(NULL, 0, MPI_BYTE, neighbours[d], 8 + 7 - d, comm, &readyRequests[d]);
+            MPI_Isend(NULL, 0, MPI_BYTE, neighbours[d], 8 + d, comm, &readyRequests[8 + d]);
+        }
+
+        MPI_Waitall(16, readyRequests, MPI_STATUSES_IGNORE);
+        MPI_Win_sync(peopleWindows[readWindow]);
+    }
+}
+
+void Simulation::receiveBorders()
+{
+    if (haloExchange == putHalos)
+    {
+        // the puts of this rank are done, and so are the ones of every neighbour into its halos
+        MPI_Win_complete(peopleWindows[readWindow]);
+        MPI_Win_wait(peopleWindows[readWindow]);
+        return;
+    }
+
+    MPI_Waitall(16, haloRequests, MPI_STATUSES_IGNORE);
+
+    // the border of a neighbour on the node faces this rank on the opposite side of its block
+    for (int d = 0; d < 8; ++d)
+    {
+        if (nodeNeighbours[d] == MPI_UNDEFINED) continue;
+
+        const Person * from = neighbourPeople[d][readWindow];
+        const Grid<SimulationLayout> & fromGrid = neighbourGrids[d];
+
+        int i = haloIndex(haloOffsets[d][0], block.rows);
+        int j = haloIndex(haloOffsets[d][1], block.cols);
+        int fromI = borderIndex(haloOffsets[7 - d][0], fromGrid.getRows() - 2);
+        int fromJ = borderIndex(haloOffsets[7 - d][1], fromGrid.getCols() - 2);
+
+        // a whole side next to a rank in the same row or column of ranks, a single person at the corners
+        int height = haloOffsets[d][0] == 0 ? block.rows : 1;
+        int width = haloOffsets[d][1] == 0 ? block.cols : 1;
+
+        local.forEach(0, height, 0, width, [&](int k, int l)
+        {
+            readMatrix[m(i + k, j + l)] = from[fromGrid.index(fromI + k, fromJ + l)];
+        });
+    }
+}
+
+void Simulation::swap()
+{
+    Person * tmp;
+    tmp = readMatrix;
+    readMatrix = writeMatrix;
+    writeMatrix = tmp;
+
+    readWindow = 1 - readWindow;
+}
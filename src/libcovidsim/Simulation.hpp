@@ -0,0 +1,184 @@
+#ifndef SIMULATION_HPP
+#define SIMULATION_HPP
+
+#include <vector> // vector
+
+#include <mpich/mpi.h>
+#include "../headers/Settings.hpp"
+#include "../headers/Person.hpp"
+#include "../headers/Rules.hpp"
+#include "../headers/Grid.hpp"
+#include "../headers/GeometricSkip.hpp"
+#include "../headers/CounterRng.hpp"
+
+// libcovidsim -----------------------------------------------------------------------------------------
+//
+// The simulation of the 2D build as an object, for programs that drive it themselves instead of
+// running a main. A Simulation splits the grid in blocks over the ranks of a communicator, with the
+// halo exchange, outbreak, population and rebalancing picked by the settings, and advances it a
+// generation at a time with step(). In between, every rank can look at its own people in place through
+// the read-only views and the counts; nothing is copied or written to a file.
+//
+// Every call but the views is collective over the communicator it was built on. Rolls draw from a
+// counter based stream of the Simulation itself, keyed by the seed setting, the replica, the
+// generation and the rank, so neither the rand() of the host nor another Simulation disturb them.
+// The builds that still roll with rand() draw other numbers from the same seed, so their runs only
+// match the ones of a Simulation when no roll can change a person (every percentage 0 or 100).
+// -----------------------------------------------------------------------------------------------------
+
+// memory order of the local blocks, RowMajor or ColumnMajor
+using SimulationLayout = ColumnMajor;
+
+// people in each state, of this rank or of the whole grid
+struct SimulationCounts
+{
+    long infected;
+    long immune;
+    long dead;
+    long vaccinated;
+};
+
+class Simulation
+{
+    private:
+
+        Settings settings;
+
+        int rows;
+        int cols;
+
+        Rules rules;
+
+        // spontaneous vaccinations, drawn as gaps between hits instead of one roll per person
+        GeometricSkip vaccinations;
+
+        int generation;
+
+        // rolls of this rank, keyed again at every generation
+        uint64_t rollSeed;
+        CounterRandom random;
+
+        // ranks are laid out in a periodic dims[0] x dims[1] grid, this one sits at coords
+        int rank, size;
+        MPI_Comm comm;
+        int dims[2];
+        int coords[2];
+
+        // people owned by this rank, they sit in rows 1..innerRows and columns 1..innerCols of the local
+        // blocks and start at row firstRow and column firstCol of the whole matrix
+        Block block;
+
+        // owned rows of every row of ranks and owned columns of every column of ranks, resized by
+        // rebalance() every rebalanceInterval generations
+        std::vector<int> blockRows;
+        std::vector<int> blockCols;
+        int rebalanceInterval;
+        double updateSeconds;
+
+        // owned people plus the halo
+        Grid<SimulationLayout> local;
+
+        // the 8 neighbours, in the order of haloOffsets
+        int neighbours[8];
+        MPI_Request haloRequests[16];
+
+        Person * readMatrix;
+        Person * writeMatrix;
+
+        // how the halos travel, see the haloExchange setting
+        int haloExchange;
+
+        // readWindow is the window holding readMatrix
+        MPI_Comm nodeComm;
+        MPI_Win peopleWindows[2];
+        int readWindow;
+
+        // rank in nodeComm of each neighbour, MPI_UNDEFINED on another node, and where both of its buffers are
+        int nodeNeighbours[8];
+        Person * neighbourPeople[8][2];
+
+        // empty messages telling the neighbours on the node that the previous generation is done
+        MPI_Request readyRequests[16];
+
+        // shape of the local block of each neighbour
+        Grid<SimulationLayout> neighbourGrids[8];
+
+        // the neighbours as a group, and where the border put to each of them lands in its buffer
+        MPI_Group neighbourGroup;
+        MPI_Datatype neighbourHaloTypes[8];
+        MPI_Aint neighbourHaloDisplacements[8];
+
+        MPI_Datatype column_t;
+        MPI_Datatype row_t;
+        MPI_Datatype corner_t;
+        MPI_Datatype subMatrixType;
+
+        inline size_t m(int i, int j) const {return local.index(i, j);}
+
+        void decompose(MPI_Comm parent);
+        void split(const std::vector<int> & heights, const std::vector<int> & widths);
+        Block blockOf(int r, const std::vector<int> & heights, const std::vector<int> & widths) const;
+        void createTypes();
+        void freeTypes();
+        Person * allocatePeople(size_t count, MPI_Win * window);
+        void freePeople(Person * people, MPI_Win * window);
+        void findNeighbours();
+        void initialize(int replica);
+        void rebalance();
+        MPI_Datatype haloType(int d) const;
+        void sendBorders();
+        void receiveBorders();
+        void update();
+        void updateBorders();
+        void updateRegion(int firstRow, int lastRow, int firstCol, int lastCol);
+        void swap();
+
+    public:
+
+        // Builds generation 0 of replica number replica on the ranks of parent, replicas only differ
+        // by their population (see populationSeed()). Throws std::invalid_argument on every rank when
+        // the grid can't be split in blocks of at least 2x2 people over them.
+        Simulation(const Settings & settings, MPI_Comm parent, int replica = 0);
+        ~Simulation();
+
+        Simulation(const Simulation &) = delete;
+        Simulation & operator=(const Simulation &) = delete;
+
+        // advances generations generations
+        void step(int generations = 1);
+
+        int getGeneration() const {return this->generation;}
+
+        // Views ---------------------------------------------------------------------------------------
+
+        // the ranks of the simulation, in a periodic grid of ranks
+        MPI_Comm getComm() const {return this->comm;}
+        int getRank() const {return this->rank;}
+        int getSize() const {return this->size;}
+
+        // people of the whole grid owned by this rank or by rank r, they move when the blocks are
+        // rebalanced
+        const Block & getBlock() const {return this->block;}
+        Block blockOf(int r) const {return blockOf(r, blockRows, blockCols);}
+
+        // The current generation of this rank: owned people sit in rows 1..getBlock().rows and columns
+        // 1..getBlock().cols of getGrid(), with a halo around them. Valid until the next step().
+        const Grid<SimulationLayout> & getGrid() const {return this->local;}
+        const Person * getPeople() const {return this->readMatrix;}
+
+        // person (row, col) of the whole grid, owned by this rank
+        const Person & at(int row, int col) const {return readMatrix[m(row - block.firstRow + 1, col - block.firstCol + 1)];}
+
+        // the owned people within getPeople(), to send them without packing
+        MPI_Datatype getOwnedType() const {return this->subMatrixType;}
+
+        // Statistics ----------------------------------------------------------------------------------
+
+        SimulationCounts countLocal() const;
+
+        // summed over every rank
+        SimulationCounts count() const;
+
+};
+
+#endif
@@ -2,61 +2,94 @@
 #include <allegro5/allegro_primitives.h>
 #include <mpich/mpi.h>
 #include "../headers/Settings.hpp"
+#include "../headers/Person.hpp"
+#include "../headers/PopulationLoader.hpp"
+#include "../headers/Outbreak.hpp"
+#include "../headers/MappedGrid.hpp"
+#include "../headers/History.hpp"
+#include "../headers/TransitionTable.hpp"
+#include "../headers/Stencil.hpp"
+#include "../headers/Grid.hpp"
+#include "../headers/CounterRng.hpp"
+#include "../headers/GeometricSkip.hpp"
 
 #define debug
 #define usingGraphics
 
+// person updates are looked up in a table built from the settings instead of going through the cascade
+#define usingTransitionTable
 
-union Person {
-	struct {
-		uint8_t isInfected:1;
-		uint8_t isImmune:1;
-		uint8_t isDead:1;
-		uint8_t isVaccinated:1;
-		uint8_t daysOfIncubation:2;
-		uint8_t daysOfInfection:3;
-		uint8_t age:7;
-	}values;
-	
-	unsigned short all;
-};
+// tiled update only: tiles far from any infected, immune or vaccinated person only roll spontaneous vaccinations
+#define usingActiveTiles
 
-Settings settings = Settings();
 
-int rows = settings.getMatrixSize();
-int cols = settings.getMatrixSize();
-int square = settings.getSquareSize();
+Settings settings;
 
-int numberOfGenerations = settings.getNumberOfGenerations();
+int rows;
+int cols;
+int square;
 
-int infectionPercentage = settings.getInfectionPercentage();
-int immunityPercentage = settings.getImmunityPercentage();
-int loseImmunityPercentage = settings.getLoseImmunityPercentage();
-int vaccinationPercentage = settings.getVaccinationPercentage();
-int deathPercentage = settings.getDeathPercentage();
+// the matrices have a one person periodic halo around them, stride is the length of a padded row
+int stride;
 
-int millisecondsToWaitForEachGeneration = settings.getMillisecodsToWaitForEachGeneration();
+// always row-major, the mapped grids and the history are written a padded row at a time
+Grid<RowMajor> padded;
 
-Person * readMatrix = new Person[settings.getMatrixSize() * settings.getMatrixSize()];
-Person * writeMatrix = new Person[settings.getMatrixSize() * settings.getMatrixSize()];
+int numberOfGenerations;
+
+int millisecondsToWaitForEachGeneration;
+
+Person * readMatrix;
+Person * writeMatrix;
+
+// file-backed grids, only used when mappedGridDirectory is set
+MappedGrid * readGrid = NULL;
+MappedGrid * writeGrid = NULL;
+
+// rows swept between two madvise calls on the mapped grids (~64 MB per band)
+int bandRows;
+
+// generation log, only used when historyFile is set
+HistoryWriter * history = NULL;
+
+// tiled update, only used when tileSize is set: every tile is copied with generationsPerTile people of
+// margin into the scratch grids and advanced that many generations before its centre is written back
+int tileSize;
+int generationsPerTile;
+Grid<RowMajor> scratch;
+Person * scratchRead;
+Person * scratchWrite;
+
+// seeds the counter based random numbers of the population and of the tiled update
+uint64_t randomSeed;
+
+// tiles of readMatrix, and of writeMatrix once updated, with nobody but susceptible and dead people
+int tileRowCount;
+int tileColCount;
+std::vector<char> quietTiles;
+std::vector<char> nextQuietTiles;
+
+// percentages handed to the kernels of the headers
+Rules rules;
+
+// spontaneous vaccinations, drawn as gaps between hits instead of one roll per person
+GeometricSkip vaccinations;
+
+#ifdef usingTransitionTable
+    TransitionTable * transitions;
+#endif //usingTransitionTable
 
 #ifdef usingGraphics
 
     ALLEGRO_DISPLAY * display;
 
-    rgb infectedRGBColor = settings.getInfectedColor();
-    rgb immuneRGBColor = settings.getImmuneColor();
-    rgb incubationRGBColor = settings.getIncubationColor();
-    rgb deadRGBColor = settings.getDeadColor();
-    rgb vaccinatedRGBColor = settings.getVaccinatedColor();
-    rgb defaultPersonRGBColor = settings.getDefaultPersonColor();
-
-    ALLEGRO_COLOR infectedColor = al_map_rgb(infectedRGBColor.r, infectedRGBColor.g, infectedRGBColor.b);
-    ALLEGRO_COLOR immuneColor = al_map_rgb(immuneRGBColor.r, immuneRGBColor.g, immuneRGBColor.b);
-    ALLEGRO_COLOR incubationColor = al_map_rgb(incubationRGBColor.r, incubationRGBColor.g, incubationRGBColor.b);
-    ALLEGRO_COLOR deadColor = al_map_rgb(deadRGBColor.r, deadRGBColor.g, deadRGBColor.b);
-    ALLEGRO_COLOR vaccinatedColor = al_map_rgb(vaccinatedRGBColor.r, vaccinatedRGBColor.g, vaccinatedRGBColor.b);
-    ALLEGRO_COLOR defaultPersonColor = al_map_rgb(defaultPersonRGBColor.r, defaultPersonRGBColor.g, defaultPersonRGBColor.b);
+    // colors from settings, set by loadSettings()
+    ALLEGRO_COLOR infectedColor;
+    ALLEGRO_COLOR immuneColor;
+    ALLEGRO_COLOR incubationColor;
+    ALLEGRO_COLOR deadColor;
+    ALLEGRO_COLOR vaccinatedColor;
+    ALLEGRO_COLOR defaultPersonColor;
 
 #endif //usingGraphics
 
@@ -71,19 +104,31 @@ Person * writeMatrix = new Person[settings.getMatrixSize() * settings.getMatrixS
 
 
 
+void loadSettings(int argc, char * argv[]);
+void allocate();
 void initialize();
 void update();
+void updateTiles(int generation, int generations);
+void updateTile(int firstRow, int firstCol, int generation, int generations);
+bool updateQuietTile(int firstRow, int firstCol, int generation, int generations);
+bool quietAround(int firstRow, int firstCol, int margin);
+bool isQuietTile(const Person * matrix, int firstRow, int firstCol);
+void markQuietTiles();
+inline void refreshHalo();
 inline void swap();
+inline void adviseBand(int i);
 void draw();
 void finalize();
-inline int m(int i, int j);
+inline size_t m(int i, int j);
 
 
 
 
-int main()
+int main(int argc, char * argv[])
 {
-    MPI_Init(NULL, NULL);
+    MPI_Init(&argc, &argv);
+
+    loadSettings(argc, argv);
 
 
     #ifdef usingGraphics
@@ -100,11 +145,37 @@ int main()
         startTime = MPI_Wtime();
     #endif //debug
 
+    allocate();
+
+    // the untiled update rolls with rand(), the tiled one with counter based numbers from randomSeed
+    srand(settings.getSeed());
+
+    randomSeed = populationSeed(settings.getSeed(), 0);
     initialize();
 
-    for (int i = 0; i < numberOfGenerations; i++)
+    #ifdef usingActiveTiles
+        if (tileSize) markQuietTiles();
+    #endif //usingActiveTiles
+
+    if (!settings.getHistoryFile().empty())
+        history = new HistoryWriter(settings.getHistoryFile(), rows, cols, settings.getHistoryKeyframeInterval(), &readMatrix[m(0,0)], stride);
+
+    // generations done by one update, the ones in between are neither drawn nor recorded
+    int step = 1;
+
+    for (int i = 0; i < numberOfGenerations; i += step)
     {
-        update();
+        if (tileSize)
+        {
+            step = std::min(generationsPerTile, numberOfGenerations - i);
+            updateTiles(i, step);
+        }
+        else
+        {
+            update();
+        }
+
+        if (history) history->record(i + step, &writeMatrix[m(0,0)]);
 
         #ifdef usingGraphics
             draw();
@@ -127,142 +198,362 @@ int main()
 
 
 
+void loadSettings(int argc, char * argv[])
+{
+    settings = Settings::load(argc, argv, MPI_COMM_WORLD);
+
+    rows = settings.getRows();
+    cols = settings.getCols();
+    square = settings.getSquareSize();
+
+    padded = Grid<RowMajor>(rows + 2, cols + 2);
+    stride = padded.getCols();
+
+    numberOfGenerations = settings.getNumberOfGenerations();
+
+    millisecondsToWaitForEachGeneration = settings.getMillisecodsToWaitForEachGeneration();
+
+    tileSize = std::min(settings.getTileSize(), std::max(rows, cols));
+    generationsPerTile = settings.getGenerationsPerTile();
+
+    if (tileSize && generationsPerTile > std::min(rows, cols))
+        throw std::invalid_argument("ERROR: generationsPerTile can't be larger than the grid");
+
+    // keyframes are written on multiples of the interval, so every one of them has to be recorded
+    if (tileSize && !settings.getHistoryFile().empty() && settings.getHistoryKeyframeInterval() % generationsPerTile != 0)
+        throw std::invalid_argument("ERROR: historyKeyframeInterval must be a multiple of generationsPerTile");
+
+    rules = rulesFrom(settings);
+    vaccinations = spontaneousVaccinations(rules);
+
+    #ifdef usingTransitionTable
+        transitions = new TransitionTable(rules);
+    #endif //usingTransitionTable
+
+    #ifdef usingGraphics
+
+        rgb infectedRGBColor = settings.getInfectedColor();
+        rgb immuneRGBColor = settings.getImmuneColor();
+        rgb incubationRGBColor = settings.getIncubationColor();
+        rgb deadRGBColor = settings.getDeadColor();
+        rgb vaccinatedRGBColor = settings.getVaccinatedColor();
+        rgb defaultPersonRGBColor = settings.getDefaultPersonColor();
+
+        infectedColor = al_map_rgb(infectedRGBColor.r, infectedRGBColor.g, infectedRGBColor.b);
+        immuneColor = al_map_rgb(immuneRGBColor.r, immuneRGBColor.g, immuneRGBColor.b);
+        incubationColor = al_map_rgb(incubationRGBColor.r, incubationRGBColor.g, incubationRGBColor.b);
+        deadColor = al_map_rgb(deadRGBColor.r, deadRGBColor.g, deadRGBColor.b);
+        vaccinatedColor = al_map_rgb(vaccinatedRGBColor.r, vaccinatedRGBColor.g, vaccinatedRGBColor.b);
+        defaultPersonColor = al_map_rgb(defaultPersonRGBColor.r, defaultPersonRGBColor.g, defaultPersonRGBColor.b);
+
+    #endif //usingGraphics
+}
+
+void allocate()
+{
+    if (tileSize)
+    {
+        scratch = Grid<RowMajor>(tileSize + 2 * generationsPerTile, tileSize + 2 * generationsPerTile);
+
+        scratchRead = new Person[scratch.size()];
+        scratchWrite = new Person[scratch.size()];
+    }
+
+    if (settings.getMappedGridDirectory().empty())
+    {
+        readMatrix = new Person[padded.size()];
+        writeMatrix = new Person[padded.size()];
+        return;
+    }
+
+    readGrid = new MappedGrid(settings.getMappedGridDirectory(), rows + 2, stride);
+    writeGrid = new MappedGrid(settings.getMappedGridDirectory(), rows + 2, stride);
+
+    readMatrix = readGrid->data();
+    writeMatrix = writeGrid->data();
+
+    bandRows = std::max(1, (int) ((64 << 20) / (stride * sizeof(Person))));
+}
+
+
 void initialize()
 {
-    for (int i = 0; i < rows; ++i)
+    if (!settings.getPopulationFile().empty())
     {
+        MappedPopulation population(settings.getPopulationFile(), rows, cols);
+
+        for (int i = 0; i < rows; ++i)
+            for (int j = 0; j < cols; ++j)
+                readMatrix[m(i,j)] = decodePopulationCell(population.at(i,j));
+
+        return;
+    }
+
+    for (int i = 0; i < rows; ++i)
         for (int j = 0; j < cols; ++j)
+            readMatrix[m(i,j)] = generatedPerson(randomSeed, i, j);
+
+    for (OutbreakSeed seed : outbreakSeeds(settings, rows, cols))
+        readMatrix[m(seed.row, seed.col)].values.isInfected = 1;
+}
+
+void update()
+{
+    refreshHalo();
+
+    // rows are swept in bands so the mapped grids can be advised in between
+    int band = readGrid ? bandRows : rows;
+
+    for (int i = 0; i < rows; i += band)
+    {
+        if (readGrid) adviseBand(i);
+
+        updateStencil(padded, i, std::min(rows, i + band), 0, cols,
+            [](int i, int j) -> const Person & {return readMatrix[m(i,j)];},
+            [](int i, int j) -> Person & {return writeMatrix[m(i,j)];},
+            #ifdef usingTransitionTable
+                [](const Person & person, int, int, short infectedNeighbours, short vaccinatedNeighbours)
+                {
+                    return transitions->next(person, infectedNeighbours, vaccinatedNeighbours, vaccinations);
+                });
+            #else
+                cascade(rules, vaccinations));
+            #endif //usingTransitionTable
+    }
+}
+
+// advances the whole grid generations generations, tile by tile, from generation on
+void updateTiles(int generation, int generations)
+{
+    for (int i = 0; i < rows; i += tileSize)
+    {
+        if (readGrid) adviseBand(i);
+
+        for (int j = 0; j < cols; j += tileSize)
         {
-            readMatrix[m(i,j)].values.isInfected = 0;
-            readMatrix[m(i,j)].values.isImmune = 0;
-            readMatrix[m(i,j)].values.isDead = 0;
-            readMatrix[m(i,j)].values.isVaccinated = 0;
-            readMatrix[m(i,j)].values.daysOfIncubation = 0;
-            readMatrix[m(i,j)].values.daysOfInfection = 0;
+            #ifdef usingActiveTiles
 
-            readMatrix[m(i,j)].values.age = rand() % 100;
+                if (quietAround(i, j, generations) && updateQuietTile(i, j, generation, generations))
+                    continue;
+
+                updateTile(i, j, generation, generations);
+                nextQuietTiles[(i / tileSize) * tileColCount + j / tileSize] = isQuietTile(writeMatrix, i, j);
 
+            #else
+                updateTile(i, j, generation, generations);
+            #endif //usingActiveTiles
         }
     }
-    
-    readMatrix[m(rows/2,cols/2)].values.isInfected = 1;
+
+    #ifdef usingActiveTiles
+        quietTiles.swap(nextQuietTiles);
+    #endif //usingActiveTiles
 }
 
-void update()
+// The spontaneous vaccinations of the tiled update are a function of the position like its other rolls:
+// every row of every generation has its own stream of gaps. Hits are only applied to the people whose
+// cascade gets to that roll. This gives the columns of row hit in generation, as positions of a run of
+// width people starting at column firstCol (which may wrap around the grid), in order.
+inline void rowVaccinations(int generation, int row, int firstCol, int width, std::vector<int> & hits)
+{
+    hits.clear();
+
+    CounterRandom random(randomSeed, generation, row, -1);
+
+    for (long col = vaccinations.gap(random); col < cols; col += vaccinations.gap(random) + 1)
+    {
+        // a column shows up more than once when the run is wider than the grid
+        for (long j = ((col - firstCol) % cols + cols) % cols; j < width; j += cols) hits.push_back(j);
+    }
+
+    std::sort(hits.begin(), hits.end());
+}
+
+#ifdef usingActiveTiles
+
+// A tile whose surroundings are quiet can only change through spontaneous vaccinations, until one
+// happens: from the next generation on its neighbours roll against it. So the tile is just copied and
+// its vaccinations of the last generation applied, unless some person close enough to reach the tile
+// in the remaining generations gets vaccinated earlier, and then the full update has to run instead.
+bool updateQuietTile(int firstRow, int firstCol, int generation, int generations)
 {
-    for(int i = 0; i < rows; i++)
+    int tileRows = std::min(tileSize, rows - firstRow);
+    int tileCols = std::min(tileSize, cols - firstCol);
+
+    std::vector<int> hits;
+
+    for (int g = 0; g < generations - 1; ++g)
     {
-        for(int j = 0; j < cols; j++)
+        int reach = generations - 1 - g;
+
+        for (int i = firstRow - reach; i < firstRow + tileRows + reach; ++i)
         {
-            short infectedNeighbours = 0;
-            short vaccinatedNeighbours = 0;
+            rowVaccinations(generation + g, (i + rows) % rows, firstCol - reach, tileCols + 2 * reach, hits);
+            if (!hits.empty()) return false;
+        }
+    }
+
+    bool quiet = true;
+
+    for (int i = firstRow; i < firstRow + tileRows; ++i)
+    {
+        memcpy(&writeMatrix[m(i, firstCol)], &readMatrix[m(i, firstCol)], tileCols * sizeof(Person));
 
-            for(int k = -1; k <= 1; k++)
+        rowVaccinations(generation + generations - 1, i, firstCol, tileCols, hits);
+
+        for (int j : hits)
+        {
+            if (!writeMatrix[m(i, firstCol + j)].values.isDead)
             {
-                for(int l = -1; l <= 1; l++)
-                {
-                    // if the neighbour is not the person itself
-                    if(k != 0 || l != 0)
-                    {
-                        // if the neighbour is infected
-                        if(readMatrix[m((i + k + rows) % rows, ((j + l + cols) % cols))].values.isInfected == true &&
-                           readMatrix[m((i + k + rows) % rows, ((j + l + cols) % cols))].values.daysOfIncubation >= 2)
-                        {
-                            ++infectedNeighbours;
-                        }
-
-                        // if the neighbour is vaccinated
-                        if(readMatrix[m((i + k + rows) % rows, ((j + l + cols) % cols))].values.isVaccinated == true)
-                        {
-                            ++vaccinatedNeighbours;
-                        }
-                    }
-                }
+                writeMatrix[m(i, firstCol + j)].values.isVaccinated = true;
+                quiet = false;
             }
+        }
+    }
 
-            // copy the person to the write matrix
-            writeMatrix[m(i,j)] = readMatrix[m(i,j)];
+    nextQuietTiles[(firstRow / tileSize) * tileColCount + firstCol / tileSize] = quiet;
+    return true;
+}
 
-            if (readMatrix[m(i,j)].values.isDead || readMatrix[m(i,j)].values.isVaccinated)
-                continue;
-            
-            // if the person is infected
-            if (readMatrix[m(i,j)].values.isInfected && !readMatrix[(i,j)].values.isImmune)
-            {
+// whether every tile within margin people of the tile at (firstRow, firstCol) is quiet
+bool quietAround(int firstRow, int firstCol, int margin)
+{
+    int lastRow = std::min(rows, firstRow + tileSize) + margin;
+    int lastCol = std::min(cols, firstCol + tileSize) + margin;
 
-                if (readMatrix[m(i,j)].values.daysOfIncubation < 3)
-                {
-                    ++writeMatrix[m(i,j)].values.daysOfIncubation;
-                    continue;
-                }
-                
-                if (readMatrix[m(i,j)].values.daysOfInfection < 7)
-                {
-                    writeMatrix[m(i,j)].values.daysOfIncubation = 0;
-                    ++writeMatrix[m(i,j)].values.daysOfInfection;
-                }
-                else if (rand()%100 < immunityPercentage)
-                {
-                    writeMatrix[m(i,j)].values.isInfected = false;
-                    writeMatrix[m(i,j)].values.isImmune = true;
-                }
-                
-                if (readMatrix[m(i,j)].values.age >= 65)
-                {
-                    if (rand()%100 < deathPercentage)
-                    {
-                        writeMatrix[m(i,j)].values.isInfected = false;
-                        writeMatrix[m(i,j)].values.isDead = true;
-                    }
-                }
-                else if (readMatrix[m(i,j)].values.age > 25 && readMatrix[m(i,j)].values.age < 65)
-                {
-                    if (rand()%100 < deathPercentage / 2)
-                    {
-                        writeMatrix[m(i,j)].values.isInfected = false;
-                        writeMatrix[m(i,j)].values.isDead = true;
-                    }
-                }
-                else
-                {
-                    if (rand()%100 < deathPercentage / 4)
-                    {
-                        writeMatrix[m(i,j)].values.isInfected = false;
-                        writeMatrix[m(i,j)].values.isDead = true;
-                    }
-                }
-            }
-            else // if the person is not infected
+    // from one tile to the next, the last tile of a row or column may be cut short
+    for (int i = firstRow - margin; i < lastRow; )
+    {
+        int row = (i + rows) % rows;
+
+        for (int j = firstCol - margin; j < lastCol; )
+        {
+            int col = (j + cols) % cols;
+
+            if (!quietTiles[(row / tileSize) * tileColCount + col / tileSize]) return false;
+
+            j += std::min(tileSize - col % tileSize, cols - col);
+        }
+
+        i += std::min(tileSize - row % tileSize, rows - row);
+    }
+
+    return true;
+}
+
+bool isQuietTile(const Person * matrix, int firstRow, int firstCol)
+{
+    for (int i = firstRow; i < std::min(rows, firstRow + tileSize); ++i)
+    {
+        for (int j = firstCol; j < std::min(cols, firstCol + tileSize); ++j)
+        {
+            const Person & person = matrix[m(i,j)];
+
+            if (person.values.isInfected || person.values.isImmune || person.values.isVaccinated) return false;
+        }
+    }
+
+    return true;
+}
+
+void markQuietTiles()
+{
+    tileRowCount = (rows + tileSize - 1) / tileSize;
+    tileColCount = (cols + tileSize - 1) / tileSize;
+
+    quietTiles.resize(tileRowCount * tileColCount);
+    nextQuietTiles.resize(tileRowCount * tileColCount);
+
+    for (int i = 0; i < rows; i += tileSize)
+        for (int j = 0; j < cols; j += tileSize)
+            quietTiles[(i / tileSize) * tileColCount + j / tileSize] = isQuietTile(readMatrix, i, j);
+}
+
+#endif //usingActiveTiles
+
+// The tile and a margin of generations people around it are copied to the scratch grids, margin rows
+// and columns wrap around the grid. Each generation the people that still have all their neighbours
+// are updated, so the updated region shrinks by one person per side, and after the last one exactly
+// the tile is left. People of the margin belong to other tiles, the counter based random numbers make
+// sure they are updated here the same way they are there.
+void updateTile(int firstRow, int firstCol, int generation, int generations)
+{
+    int tileRows = std::min(tileSize, rows - firstRow);
+    int tileCols = std::min(tileSize, cols - firstCol);
+
+    int scratchRows = tileRows + 2 * generations;
+    int scratchCols = tileCols + 2 * generations;
+
+    // scratch (0, 0) is person (originRow, originCol) of the grid
+    int originRow = firstRow - generations + rows;
+    int originCol = firstCol - generations + cols;
+
+    for (int i = 0; i < scratchRows; ++i)
+    {
+        int row = (originRow + i) % rows;
+
+        for (int j = 0; j < scratchCols; ++j)
+            scratchRead[scratch.index(i,j)] = readMatrix[m(row, (originCol + j) % cols)];
+    }
+
+    // spontaneous vaccinations of the row being swept, hit is the first one not behind the sweep
+    std::vector<int> hits;
+    int hitsRow = -1;
+    size_t hit = 0;
+
+    for (int g = 0; g < generations; ++g)
+    {
+        updateStencil(scratch, g + 1, scratchRows - g - 1, g + 1, scratchCols - g - 1,
+            [](int i, int j) -> const Person & {return scratchRead[scratch.index(i,j)];},
+            [](int i, int j) -> Person & {return scratchWrite[scratch.index(i,j)];},
+            [&](const Person & person, int i, int j, short infectedNeighbours, short vaccinatedNeighbours)
             {
-                if (infectedNeighbours > 0 &&
-                    rand()%100 < infectionPercentage * infectedNeighbours &&
-                    readMatrix[m(i,j)].values.isImmune == false)
-                {
-                    writeMatrix[m(i,j)].values.isInfected = true;
-                    continue;
-                }
+                CounterRandom random(randomSeed, generation + g, (originRow + i) % rows, (originCol + j) % cols);
 
-                if (rand()%100000 < vaccinationPercentage)
+                if (i != hitsRow)
                 {
-                    writeMatrix[m(i,j)].values.isVaccinated = true;
-                    continue;
+                    rowVaccinations(generation + g, (originRow + i) % rows, originCol, scratchCols, hits);
+                    hitsRow = i;
+                    hit = 0;
                 }
 
-                if (vaccinatedNeighbours > 0 &&
-                    rand()%250 < vaccinationPercentage * vaccinatedNeighbours)
+                auto vaccinated = [&]()
                 {
-                    writeMatrix[m(i,j)].values.isVaccinated = true;
-                    continue;
-                }
+                    while (hit < hits.size() && hits[hit] < j) ++hit;
+                    return hit < hits.size() && hits[hit] == j;
+                };
 
-                if(rand()%100 < loseImmunityPercentage)
-                {
-                    writeMatrix[m(i,j)].values.isImmune = false;
-                    continue;
-                }
-            }
-        }
+                #ifdef usingTransitionTable
+                    return transitions->next(person, infectedNeighbours, vaccinatedNeighbours, vaccinated, random);
+                #else
+                    return nextPerson(person, infectedNeighbours, vaccinatedNeighbours, rules, vaccinated, random);
+                #endif //usingTransitionTable
+            });
+
+        hitsRow = -1;
+
+        std::swap(scratchRead, scratchWrite);
     }
+
+    for (int i = 0; i < tileRows; ++i)
+    {
+        memcpy(&writeMatrix[m(firstRow + i, firstCol)], &scratchRead[scratch.index(generations + i, generations)],
+               tileCols * sizeof(Person));
+    }
+}
+
+// copies the opposite borders into the halo so the neighbours of border people wrap around
+inline void refreshHalo()
+{
+    for (int i = 0; i < rows; ++i)
+    {
+        readMatrix[m(i,-1)] = readMatrix[m(i,cols - 1)];
+        readMatrix[m(i,cols)] = readMatrix[m(i,0)];
+    }
+
+    // whole padded rows, corners included
+    memcpy(&readMatrix[m(-1,-1)], &readMatrix[m(rows - 1,-1)], stride * sizeof(Person));
+    memcpy(&readMatrix[m(rows,-1)], &readMatrix[m(0,-1)], stride * sizeof(Person));
 }
 
 inline void swap(){
@@ -270,15 +561,33 @@ inline void swap(){
     tmp = readMatrix;
     readMatrix = writeMatrix;
     writeMatrix = tmp;
+
+    MappedGrid * tmpGrid;
+    tmpGrid = readGrid;
+    readGrid = writeGrid;
+    writeGrid = tmpGrid;
+}
+
+inline void adviseBand(int i)
+{
+    // the band being swept plus the next one are prefetched, the band before the previous one won't be
+    // touched again in this generation; the grids are addressed in padded rows, halo rows included
+    int first = i + 1;
+    int prefetchEnd = std::min(rows + 2, first + 2 * bandRows);
+    int releaseBegin = std::max(0, first - 2 * bandRows);
+    int releaseEnd = std::max(0, first - bandRows);
+
+    readGrid->adviseBand(first, prefetchEnd, releaseBegin, releaseEnd);
+    writeGrid->adviseBand(first, prefetchEnd, releaseBegin, releaseEnd);
 }
 
 void draw()
 {
     al_clear_to_color(defaultPersonColor);
 
-    for (int j = 0; j < rows; ++j)
+    for (int j = 0; j < cols; ++j)
     {
-        for (int i = 0; i < cols; ++i)
+        for (int i = 0; i < rows; ++i)
         {
             if (readMatrix[m(i,j)].values.isInfected && readMatrix[m(i,j)].values.daysOfIncubation < 3)
             {
@@ -315,12 +624,35 @@ void draw()
 
 void finalize()
 {
-    delete [] readMatrix;
-    delete [] writeMatrix;
+    // flushes the pending generations and writes the keyframe index
+    delete history;
+
+    #ifdef usingTransitionTable
+        delete transitions;
+    #endif //usingTransitionTable
+
+    if (tileSize)
+    {
+        delete [] scratchRead;
+        delete [] scratchWrite;
+    }
+
+    if (readGrid)
+    {
+        delete readGrid;
+        delete writeGrid;
+    }
+    else
+    {
+        delete [] readMatrix;
+        delete [] writeMatrix;
+    }
+
     MPI_Finalize();
 }
 
-inline int m(int i, int j)
+// i and j go from -1 to rows and cols, -1 and rows/cols being the halo
+inline size_t m(int i, int j)
 {
-    return ((i * cols) + j);
+    return padded.index(i + 1, j + 1);
 }
\ No newline at end of file
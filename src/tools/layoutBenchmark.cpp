@@ -0,0 +1,70 @@
+#include <chrono> // steady_clock
+#include <cstdio> // printf
+#include <cstdlib> // atoi, rand
+#include <utility> // swap
+#include <vector> // vector
+
+#include "../headers/Person.hpp"
+#include "../headers/Rules.hpp"
+#include "../headers/Grid.hpp"
+#include "../headers/GeometricSkip.hpp"
+
+// Times one generation of the column sum kernel over a padded size * size grid in both layouts,
+// once walking it in the order of the layout and once in the other one, and prints the nanoseconds
+// spent per person. The halo is left as it is, only the memory order changes between the runs.
+//
+//      ./bin/layout-benchmark.out [size] [generations]
+
+Rules rules = {3, 90, 1, 1, 3};
+
+template <typename Layout, typename Order>
+double benchmark(int size, int generations)
+{
+    Grid<Layout> grid(size + 2, size + 2);
+
+    std::vector<Person> read(grid.size());
+    std::vector<Person> write(grid.size());
+
+    GeometricSkip vaccinations = spontaneousVaccinations(rules);
+
+    srand(0);
+
+    for (Person & person : read)
+    {
+        person.all = 0;
+        person.values.age = rand() % 100;
+        person.values.isInfected = rand() % 10 == 0;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (int generation = 0; generation < generations; ++generation)
+    {
+        Order::sweep(1, size + 1, 1, size + 1,
+            [&](int i, int j) -> const Person & {return read[grid.index(i, j)];},
+            [&](int i, int j, short infectedNeighbours, short vaccinatedNeighbours)
+            {
+                write[grid.index(i, j)] = nextPerson(read[grid.index(i, j)], infectedNeighbours, vaccinatedNeighbours, rules, vaccinations);
+            });
+
+        std::swap(read, write);
+    }
+
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+
+    return elapsed.count() / ((double) size * size * generations);
+}
+
+int main(int argc, char * argv[])
+{
+    int size = argc > 1 ? atoi(argv[1]) : 4096;
+    int generations = argc > 2 ? atoi(argv[2]) : 5;
+
+    printf("%d x %d people, %d generations\n", size, size, generations);
+    printf("RowMajor, rows first: %.2f ns per person\n", benchmark<RowMajor, RowMajor>(size, generations));
+    printf("RowMajor, columns first: %.2f ns per person\n", benchmark<RowMajor, ColumnMajor>(size, generations));
+    printf("ColumnMajor, columns first: %.2f ns per person\n", benchmark<ColumnMajor, ColumnMajor>(size, generations));
+    printf("ColumnMajor, rows first: %.2f ns per person\n", benchmark<ColumnMajor, RowMajor>(size, generations));
+
+    return 0;
+}
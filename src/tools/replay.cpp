@@ -0,0 +1,76 @@
+#include <cstdio> // printf
+#include <cstdlib> // atoi
+#include <vector> // vector
+
+#include "../headers/Person.hpp"
+#include "../headers/History.hpp"
+#include "../headers/PopulationLoader.hpp"
+
+// Rebuilds one generation out of a history log, prints how many people are in each state and,
+// when an output path is given, saves it as a population raster that can seed a new run.
+//
+//      ./bin/replay.out history.bin <generation> [population.bin]
+
+int main(int argc, char * argv[])
+{
+    if (argc < 3)
+    {
+        printf("Usage: %s <history file> <generation> [population file]\n", argv[0]);
+        return 1;
+    }
+
+    HistoryReader history(argv[1]);
+
+    int rows = history.getRows();
+    int cols = history.getCols();
+    int generation = atoi(argv[2]);
+
+    std::vector<Person> grid((size_t) rows * cols);
+
+    if (!history.seek(generation, grid.data()))
+    {
+        printf("Generation %d is not in %s\n", generation, argv[1]);
+        return 1;
+    }
+
+    long infected = 0, immune = 0, dead = 0, vaccinated = 0;
+
+    for (Person & person : grid)
+    {
+        infected += person.values.isInfected;
+        immune += person.values.isImmune;
+        dead += person.values.isDead;
+        vaccinated += person.values.isVaccinated;
+    }
+
+    printf("Generation %d\n", generation);
+    printf("Infected: %ld\nImmune: %ld\nDead: %ld\nVaccinated: %ld\n", infected, immune, dead, vaccinated);
+
+    if (argc > 3)
+    {
+        FILE * output = fopen(argv[3], "wb");
+        if (!output)
+        {
+            printf("Couldn't create %s\n", argv[3]);
+            return 1;
+        }
+
+        PopulationHeader header = {{'C', 'V', 'P', 'M'}, populationVersion, (uint32_t) rows, (uint32_t) cols};
+        fwrite(&header, sizeof(header), 1, output);
+
+        for (Person & person : grid)
+        {
+            uint16_t flags = (person.values.isInfected ? populationInfected : 0) |
+                             (person.values.isImmune ? populationImmune : 0) |
+                             (person.values.isDead ? populationDead : 0) |
+                             (person.values.isVaccinated ? populationVaccinated : 0);
+
+            uint16_t cell = person.values.age | (flags << 8);
+            fwrite(&cell, sizeof(cell), 1, output);
+        }
+
+        fclose(output);
+    }
+
+    return 0;
+}